@@ -2,13 +2,35 @@ param (
     [Parameter(Mandatory = $true, HelpMessage = "The path where to download the tarball")]
     [string]$Path,
     [Parameter(Mandatory = $true, HelpMessage = "The URL of the tarball")]
-    [Uri]$URL
+    [Uri]$URL,
+    [Parameter(HelpMessage = "The directory of the content-addressed cache of rootfses, shared by all jobs of the machine")]
+    [string]$Cache = "",
+    [Parameter(HelpMessage = "How many ranges of the tarball to download at once")]
+    [int]$Connections = 8
 )
 
 # Global variables
 $RootFS = "${Path}"
 $Directory = Split-Path -Path "${RootFS}" -Parent
 $Checksums = "${Directory}\SHA256SUMS"
+# Ranges are never smaller than this, so that small files are not split for nothing
+$MinimumRangeSize = 16MB
+$MaximumAttempts = 5
+# Tells apart the parts of this run when the server sends nothing to identify the tarball
+$RunID = [Guid]::NewGuid()
+
+if ("${Cache}" -eq "") {
+    if ("${env:RUNNER_TOOL_CACHE}" -ne "") {
+        $Cache = "${env:RUNNER_TOOL_CACHE}\wsl-rootfs"
+    } else {
+        $Cache = "${env:LOCALAPPDATA}\wsl-rootfs"
+    }
+}
+
+Add-Type -AssemblyName System.Net.Http
+[Net.ServicePointManager]::SecurityProtocol = [Net.SecurityProtocolType]::Tls12
+# Windows PowerShell only opens 2 connections per server by default
+[Net.ServicePointManager]::DefaultConnectionLimit = [Math]::Max($Connections, 2)
 
 # Helper functions
 
@@ -34,68 +56,321 @@ function Remove-File {
     Remove-Item -Path "${Path}" -Force 2>&1 | Out-Null
 }
 
-# Test-Checksums returns true if the current rootfs checksum matches the remote one.
-# Returns false otherwise, or if any error arises.
-function Test-Checksums {
-    # Get Hash of the current RootFS
-    if (!(Test-Path -Path ${RootFS})) {
-        return $false
-    }
-
-    $oldSHA256 = (Get-FileHash "${Rootfs}" -Algorithm SHA256).Hash
-    if ($oldSHA256 -eq "") {
-        Write-Warning "Could not compute hash of ${Rootfs}"
-        return $false
-    }
-
-    # Download remote checksum
+# Get-RemoteChecksum returns the published SHA256 of the rootfs, or an empty string if any error arises.
+function Get-RemoteChecksum {
     $checksumURL = "$(Get-URIParent -URI "${URL}")SHA256SUMS"
-    pwsh.exe -Command pwsh.exe -Command Invoke-WebRequest -Uri "${checksumURL}" -OutFile "${Checksums}" -Resume -MaximumRetryCount 5 -RetryIntervalSec 2
+    pwsh.exe -Command Invoke-WebRequest -Uri "${checksumURL}" -OutFile "${Checksums}" -Resume -MaximumRetryCount 5 -RetryIntervalSec 2
     if (! $?) {
         Write-Warning "Could not download checksums"
-        return $false
+        return ""
     }
-    
+
     if (!(Test-Path "${Checksums}")) {
         Write-Warning "Could not download checksums"
-        return $false
+        return ""
     }
 
     # Parse checksum file
     $image = $URL.Segments[$Url.Segments.Length - 1]
     $pattern = "(\w+)  ${image}"
 
-    $newSHA256 = (Select-String -Pattern "${pattern}" -Path "${Checksums}").Matches[0].Groups[1]
-    if ($newSHA256 -eq "") {
+    $match = Select-String -Pattern "${pattern}" -Path "${Checksums}"
+    if ($null -eq $match) {
         Write-Warning "Could not find $image in checksums file"
-        return $false
+        return ""
     }
 
-    # Compare checksums
-    if ($oldSHA256 -ne $newSHA256) {
+    return "$($match.Matches[0].Groups[1])".ToUpper()
+}
+
+# Test-Checksum returns true if the file at $File exists and its checksum is $SHA256.
+function Test-Checksum {
+    param (
+        [Parameter(Mandatory=$true)] [string]$File,
+        [Parameter(Mandatory=$true)] [string]$SHA256
+    )
+
+    if (!(Test-Path -Path "${File}")) {
         return $false
-    }    
-    return $true
+    }
+
+    return ((Get-FileHash "${File}" -Algorithm SHA256).Hash -eq $SHA256)
+}
+
+# Get-PartTag returns what identifies the content of the tarball in the names of its part
+# files: its expected checksum if it is known, or else a digest of the validators sent by the
+# server. Parts of a tarball that has since changed then never match.
+function Get-PartTag {
+    param (
+        [Parameter(Mandatory=$true)] [System.Net.Http.HttpResponseMessage]$Response,
+        [Parameter(Mandatory=$true)] [AllowEmptyString()] [string]$Expected
+    )
+
+    if ($Expected -ne "") {
+        return $Expected
+    }
+
+    $validator = "$($Response.Headers.ETag) $($Response.Content.Headers.LastModified) $($Response.Content.Headers.ContentLength)"
+    if ($validator.Trim() -eq "") {
+        # Nothing tells the content apart, so parts are only resumed within this run
+        $validator = "${RunID}"
+    }
+
+    $sha = [System.Security.Cryptography.SHA256]::Create()
+    try {
+        $digest = $sha.ComputeHash([System.Text.Encoding]::UTF8.GetBytes($validator))
+        return [BitConverter]::ToString($digest).Replace("-", "").Substring(0, 16)
+    } finally {
+        $sha.Dispose()
+    }
+}
+
+# Get-Ranges splits the tarball into the ranges downloaded in parallel. A single range
+# covering the whole file is returned when the server does not support ranged requests.
+# Part files are named after the content and the start of their range, and the parts of
+# any other tarball or split are removed.
+function Get-Ranges {
+    param (
+        [Parameter(Mandatory=$true)] [System.Net.Http.HttpClient]$Client,
+        [Parameter(Mandatory=$true)] [AllowEmptyString()] [string]$Expected
+    )
+
+    $request = New-Object System.Net.Http.HttpRequestMessage([System.Net.Http.HttpMethod]::Head, $URL)
+    $response = $Client.SendAsync($request).GetAwaiter().GetResult()
+    $response.EnsureSuccessStatusCode() | Out-Null
+
+    $length = $response.Content.Headers.ContentLength
+    $ranged = ($null -ne $length) -and ($response.Headers.AcceptRanges -contains "bytes")
+    $tag = Get-PartTag -Response $response -Expected $Expected
+    $response.Dispose()
+    if (!$ranged) {
+        $ranges = @(@{ Start = 0; End = $null; File = "${RootFS}.${tag}.0.part" })
+        Remove-Parts -Keep $ranges
+        return ,$ranges
+    }
+
+    $count = [Math]::Max(1, [Math]::Min($Connections, [Math]::Floor($length / $MinimumRangeSize)))
+    $size = [Math]::Ceiling($length / $count)
+    $ranges = @()
+    for ($i = 0; $i -lt $count; $i++) {
+        $start = $i * $size
+        $end = [Math]::Min($length, $start + $size) - 1
+        $ranges += @{ Start = $start; End = $end; File = "${RootFS}.${tag}.${start}.part" }
+    }
+    Remove-Parts -Keep $ranges
+    return ,$ranges
+}
+
+# Start-RangeDownload resumes downloading a range where its part file ends. It returns
+# the task copying the response into the part file, or $null if the range is complete.
+# A part longer than its range cannot be trusted, and is downloaded again.
+function Start-RangeDownload {
+    param (
+        [Parameter(Mandatory=$true)] [System.Net.Http.HttpClient]$Client,
+        [Parameter(Mandatory=$true)] [hashtable]$Range
+    )
+
+    $done = 0
+    if (Test-Path -Path $Range.File) {
+        $done = (Get-Item -Path $Range.File).Length
+    }
+
+    if ($null -ne $Range.End) {
+        $size = $Range.End - $Range.Start + 1
+        if ($done -eq $size) {
+            return $null
+        }
+        if ($done -gt $size) {
+            Remove-File -Path $Range.File
+            $done = 0
+        }
+    }
+
+    $from = $Range.Start + $done
+    $request = New-Object System.Net.Http.HttpRequestMessage([System.Net.Http.HttpMethod]::Get, $URL)
+    if (($null -ne $Range.End) -or ($done -gt 0)) {
+        $request.Headers.Range = New-Object System.Net.Http.Headers.RangeHeaderValue($from, $Range.End)
+    }
+
+    $response = $Client.SendAsync($request, [System.Net.Http.HttpCompletionOption]::ResponseHeadersRead).GetAwaiter().GetResult()
+    $response.EnsureSuccessStatusCode() | Out-Null
+
+    # A server that ignores the range sends the whole file again
+    $mode = [System.IO.FileMode]::Append
+    if (($done -gt 0) -and ($response.StatusCode -ne [System.Net.HttpStatusCode]::PartialContent)) {
+        $mode = [System.IO.FileMode]::Create
+    }
+
+    $Range.Stream = New-Object System.IO.FileStream($Range.File, $mode, [System.IO.FileAccess]::Write)
+    $Range.Response = $response
+    return $response.Content.ReadAsStreamAsync().GetAwaiter().GetResult().CopyToAsync($Range.Stream)
+}
+
+# Complete-Range closes the part file and the response of a range once its task completed.
+function Complete-Range {
+    param (
+        [Parameter(Mandatory=$true)] [hashtable]$Range
+    )
+
+    if ($null -ne $Range.Stream) {
+        $Range.Stream.Dispose()
+        $Range.Stream = $null
+    }
+    if ($null -ne $Range.Response) {
+        $Range.Response.Dispose()
+        $Range.Response = $null
+    }
+}
+
+# Add-PartToHash feeds a downloaded part file to the running SHA256 of the tarball.
+function Add-PartToHash {
+    param (
+        [Parameter(Mandatory=$true)] [System.Security.Cryptography.HashAlgorithm]$Hash,
+        [Parameter(Mandatory=$true)] [string]$File,
+        [Parameter(Mandatory=$true)] [System.IO.Stream]$Output
+    )
+
+    $buffer = New-Object byte[] (4MB)
+    $part = [System.IO.File]::OpenRead($File)
+    try {
+        while (($read = $part.Read($buffer, 0, $buffer.Length)) -gt 0) {
+            $Hash.TransformBlock($buffer, 0, $read, $null, 0) | Out-Null
+            $Output.Write($buffer, 0, $read)
+        }
+    } finally {
+        $part.Dispose()
+    }
+}
+
+# Invoke-Download fetches the ranges of the tarball in parallel into "${RootFS}.tmp". Parts
+# are hashed and appended in order as soon as they and all the ones before them are complete,
+# while the others are still downloading, so that the digest is ready with the last byte.
+# Part files are kept if the download fails, so that the next attempt resumes them.
+# Returns the SHA256 of the tarball.
+function Invoke-Download {
+    param (
+        [Parameter(Mandatory=$true)] [AllowEmptyString()] [string]$Expected
+    )
+
+    $client = New-Object System.Net.Http.HttpClient
+    $client.Timeout = [System.Threading.Timeout]::InfiniteTimeSpan
+    $hash = [System.Security.Cryptography.SHA256]::Create()
+    $output = $null
+    try {
+        $ranges = Get-Ranges -Client $client -Expected $Expected
+        $tasks = @()
+        foreach ($range in $ranges) {
+            $tasks += Start-RangeDownload -Client $client -Range $range
+        }
+
+        $output = [System.IO.File]::Create("${RootFS}.tmp")
+        $next = 0
+        while ($next -lt $ranges.Count) {
+            $task = $tasks[$next]
+            if (($null -ne $task) -and !$task.IsCompleted) {
+                Start-Sleep -Milliseconds 100
+                continue
+            }
+
+            Complete-Range -Range $ranges[$next]
+            if (($null -ne $task) -and ($task.IsFaulted -or $task.IsCanceled)) {
+                throw "Could not download range ${next}: $($task.Exception.InnerException.Message)"
+            }
+
+            # A server that ignored the range sent more than it holds
+            $range = $ranges[$next]
+            if (($null -ne $range.End) -and ((Get-Item -Path $range.File).Length -ne ($range.End - $range.Start + 1))) {
+                Remove-File -Path $range.File
+                throw "Could not download range ${next}: the server did not send the requested range"
+            }
+
+            Add-PartToHash -Hash $hash -File $ranges[$next].File -Output $output
+            $next++
+        }
+
+        $hash.TransformFinalBlock((New-Object byte[] 0), 0, 0) | Out-Null
+        return [BitConverter]::ToString($hash.Hash).Replace("-", "")
+    } finally {
+        if ($null -ne $ranges) {
+            foreach ($range in $ranges) {
+                Complete-Range -Range $range
+            }
+        }
+        if ($null -ne $output) {
+            $output.Dispose()
+        }
+        $hash.Dispose()
+        $client.Dispose()
+    }
+}
+
+# Remove-Parts removes the part files of the tarball but the ones of the ranges in $Keep.
+function Remove-Parts {
+    param (
+        [hashtable[]]$Keep = @()
+    )
+
+    $kept = $Keep | ForEach-Object { Split-Path -Path $_.File -Leaf }
+    Get-ChildItem -Path "${RootFS}.*part*" -ErrorAction SilentlyContinue |
+        Where-Object { $kept -notcontains $_.Name } |
+        Remove-Item -Force 2>&1 | Out-Null
 }
 
 function main {
     New-Item -Type Directory -Force "${Directory}" 2>&1 | Out-Null
+    New-Item -Type Directory -Force "${Cache}" 2>&1 | Out-Null
 
-    # Validate checksum
-    if ( Test-Checksums ) {
-        Write-Warning "Cache hit: skipping download"
-        return 0
+    $expected = Get-RemoteChecksum
+    if ($expected -ne "") {
+        # Validate checksum
+        if ( Test-Checksum -File "${RootFS}" -SHA256 $expected ) {
+            Write-Warning "Cache hit: skipping download"
+            return 0
+        }
+
+        # Identical rootfses are only ever downloaded once per machine. The cache is shared
+        # by every job, so an entry is checked before it is trusted.
+        $cached = "${Cache}\${expected}.tar.gz"
+        if ( Test-Path -Path "${cached}" ) {
+            Copy-Item -Force "${cached}" "${RootFS}.tmp"
+            if ( Test-Checksum -File "${RootFS}.tmp" -SHA256 $expected ) {
+                Write-Warning "Cache hit: copied ${cached}"
+                Move-Item -Force "${RootFS}.tmp" "${RootFS}"
+                return 0
+            }
+
+            Write-Warning "Cache entry ${cached} is corrupted: removing it"
+            Remove-File -Path "${cached}"
+        }
     }
 
-    # Download Rootfs into temp file
-    pwsh.exe -Command Invoke-WebRequest -Uri "${URL}" -OutFile "${RootFS}.tmp" -Resume -MaximumRetryCount 5 -RetryIntervalSec 2
-    if ( ! $? ) {
+    # Download Rootfs into temp file, resuming the parts of the previous attempts
+    $actual = ""
+    for ($attempt = 1; $attempt -le $MaximumAttempts; $attempt++) {
+        try {
+            $actual = Invoke-Download -Expected $expected
+            break
+        } catch {
+            Write-Warning "Download attempt ${attempt} failed: $_"
+            Start-Sleep -Seconds 2
+        }
+    }
+
+    if ($actual -eq "") {
         Write-Error "Error: Failed download"
         return 1
     }
 
-    # Move downloaded tmp file into position
+    Remove-Parts
+    if (($expected -ne "") -and ($actual -ne $expected)) {
+        Write-Error "Error: Checksum mismatch: expected ${expected}, got ${actual}"
+        return 1
+    }
+
+    # Move downloaded tmp file into position, and into the cache
     Move-Item -Force "${RootFS}.tmp" "${RootFS}"
+    Copy-Item -Force "${RootFS}" "${Cache}\${actual}.tar.gz.tmp"
+    Move-Item -Force "${Cache}\${actual}.tar.gz.tmp" "${Cache}\${actual}.tar.gz"
     return 0
 }
 
@@ -107,4 +382,3 @@ Remove-File -Path "${RootFS}.tmp"
 Remove-File -Path "${Checksums}"
 
 Exit($exitCode)
-
@@ -0,0 +1,288 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// The shell that runs the commands. Profiles are skipped, like for run.
+#define BATCH_SHELL L"exec bash --noprofile --norc"
+
+// Marks the end of a command on the stderr of the shell, followed by a token
+// unique to the session and the exit code of the command.
+#define BATCH_RESULT_MARKER '\036'
+
+namespace {
+    HRESULT ReadCommands(std::wstring_view source, std::vector<Batch::Command>* commands);
+    HRESULT ReadAll(HANDLE input, std::string* data);
+    std::string GenerateToken();
+    HRESULT WaitForResult(HANDLE shellError, const std::string& marker, std::string* pending, DWORD* exitCode);
+    void Forward(HANDLE output, std::string* pending, size_t size);
+}
+
+HRESULT Batch::Run(std::wstring_view source, bool keepGoing, DWORD* exitCode)
+{
+    std::vector<Command> commands;
+    HRESULT hr = ReadCommands(source, &commands);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    return RunCommands(commands, keepGoing, exitCode);
+}
+
+HRESULT Batch::RunCommands(const std::vector<Command>& commands, bool keepGoing, DWORD* exitCode)
+{
+    Timings::Scope timing("batch");
+    HRESULT hr;
+
+    // The commands are written to the stdin of the shell, and their end is
+    // reported on its stderr, which is parsed and otherwise forwarded. The
+    // output of the commands goes straight to the console. Only the shell
+    // ends are inherited, so that the shell does not hold either pipe open.
+    HANDLE shellInput;
+    HANDLE inputWrite;
+    HANDLE errorRead = nullptr;
+    HANDLE shellError = nullptr;
+    SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
+    if (!CreatePipe(&shellInput, &inputWrite, &sa, 0)) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (!SetHandleInformation(inputWrite, HANDLE_FLAG_INHERIT, 0)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(shellInput);
+        CloseHandle(inputWrite);
+        return hr;
+    }
+
+    if ((!CreatePipe(&errorRead, &shellError, &sa, 0)) ||
+        (!SetHandleInformation(errorRead, HANDLE_FLAG_INHERIT, 0))) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        if (errorRead != nullptr) {
+            CloseHandle(errorRead);
+            CloseHandle(shellError);
+        }
+
+        CloseHandle(shellInput);
+        CloseHandle(inputWrite);
+        return hr;
+    }
+
+    HANDLE shell;
+    hr = g_wslApi.WslLaunch(BATCH_SHELL, true, shellInput, GetStdHandle(STD_OUTPUT_HANDLE), shellError, &shell);
+
+    // Close our copies of the shell ends so that its stderr reaches the end of
+    // file if it exits early.
+    CloseHandle(shellInput);
+    CloseHandle(shellError);
+    if (FAILED(hr)) {
+        CloseHandle(inputWrite);
+        CloseHandle(errorRead);
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    const std::string token = GenerateToken();
+    const std::string marker = BATCH_RESULT_MARKER + token + " ";
+    std::string pending;
+    *exitCode = 0;
+    for (size_t index = 0; index < commands.size(); index += 1) {
+        // Commands do not read from the stdin of the shell, which carries the
+        // following commands, and are evaluated so that a syntax error only
+        // fails that command.
+        Timings::Scope commandTiming(commands[index].phase);
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER start;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&start);
+        const std::string line = "__batch_command=" + QuoteShellArgument(commands[index].script) +
+                                 "; eval \"$__batch_command\" </dev/null; printf '\\036%s %d\\n' " +
+                                 token + " \"$?\" >&2\n";
+
+        DWORD written;
+        DWORD commandExitCode = 1;
+        if (!WriteFile(inputWrite, line.data(), (DWORD)line.size(), &written, nullptr)) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+
+        } else {
+            hr = WaitForResult(errorRead, marker, &pending, &commandExitCode);
+        }
+
+        if (FAILED(hr)) {
+            // The shell exited, most likely because the command called exit.
+            commandTiming.SetResult(hr);
+            Helpers::PrintMessage(MSG_BATCH_SHELL_EXITED, (ULONG)(index + 1), (ULONG)commands.size());
+            if (*exitCode == 0) {
+                *exitCode = 1;
+            }
+
+            hr = S_OK;
+            break;
+        }
+
+        LARGE_INTEGER end;
+        QueryPerformanceCounter(&end);
+        const ULONG milliseconds = (ULONG)(((end.QuadPart - start.QuadPart) * 1000) / frequency.QuadPart);
+        Helpers::PrintMessage(MSG_BATCH_COMMAND_RESULT, (ULONG)(index + 1), (ULONG)commands.size(), commandExitCode, milliseconds, commands[index].description.c_str());
+        if (commandExitCode != 0) {
+            commandTiming.SetResult(E_FAIL);
+            if (*exitCode == 0) {
+                *exitCode = commandExitCode;
+            }
+
+            if (!keepGoing) {
+                break;
+            }
+        }
+    }
+
+    // Closing the stdin of the shell makes it exit.
+    CloseHandle(inputWrite);
+    Forward(GetStdHandle(STD_ERROR_HANDLE), &pending, pending.size());
+    WaitForSingleObject(shell, INFINITE);
+    CloseHandle(shell);
+    CloseHandle(errorRead);
+    timing.SetResult((*exitCode == 0) ? S_OK : E_FAIL);
+    return hr;
+}
+
+std::string Batch::QuoteShellArgument(std::string_view argument)
+{
+    std::string quoted = "'";
+    for (const char ch : argument) {
+        if (ch == '\'') {
+            quoted += "'\\''";
+
+        } else {
+            quoted += ch;
+        }
+    }
+
+    quoted += "'";
+    return quoted;
+}
+
+namespace {
+    HRESULT ReadCommands(std::wstring_view source, std::vector<Batch::Command>* commands)
+    {
+        std::string data;
+        HRESULT hr;
+        if (source == Batch::StdinSource) {
+            hr = ReadAll(GetStdHandle(STD_INPUT_HANDLE), &data);
+
+        } else {
+            const std::wstring path(source);
+            HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            hr = ReadAll(file, &data);
+            CloseHandle(file);
+        }
+
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // One command per line, in UTF-8. Empty lines and comments are skipped.
+        if (data.rfind("\xEF\xBB\xBF", 0) == 0) {
+            data.erase(0, 3);
+        }
+
+        size_t start = 0;
+        while (start < data.size()) {
+            size_t end = data.find('\n', start);
+            if (end == std::string::npos) {
+                end = data.size();
+            }
+
+            std::string line = data.substr(start, end - start);
+            if ((!line.empty()) && (line.back() == '\r')) {
+                line.pop_back();
+            }
+
+            const size_t first = line.find_first_not_of(" \t");
+            if ((first != std::string::npos) && (line[first] != '#')) {
+                std::wstring description(line.size(), L'\0');
+                description.resize(MultiByteToWideChar(CP_UTF8, 0, line.data(), (int)line.size(), description.data(), (int)description.size()));
+                commands->push_back({line, description, "batch-command"});
+            }
+
+            start = end + 1;
+        }
+
+        return S_OK;
+    }
+
+    HRESULT ReadAll(HANDLE input, std::string* data)
+    {
+        char buffer[4096];
+        DWORD bytesRead;
+        while (ReadFile(input, buffer, sizeof(buffer), &bytesRead, nullptr)) {
+            if (bytesRead == 0) {
+                return S_OK;
+            }
+
+            data->append(buffer, bytesRead);
+        }
+
+        // A pipe whose writer has gone is the end of the input.
+        const DWORD error = GetLastError();
+        return (error == ERROR_BROKEN_PIPE) ? S_OK : HRESULT_FROM_WIN32(error);
+    }
+
+    std::string GenerateToken()
+    {
+        std::random_device random;
+        char token[17];
+        sprintf_s(token, "%08x%08x", random(), random());
+        return token;
+    }
+
+    HRESULT WaitForResult(HANDLE shellError, const std::string& marker, std::string* pending, DWORD* exitCode)
+    {
+        while (true) {
+            // The marker is not necessarily at the start of a line, as the
+            // output of the command does not have to end with a newline.
+            const size_t position = pending->find(marker);
+            if (position != std::string::npos) {
+                const size_t end = pending->find('\n', position);
+                if (end != std::string::npos) {
+                    Forward(GetStdHandle(STD_ERROR_HANDLE), pending, position);
+                    const size_t length = end - position - marker.size();
+                    *exitCode = std::stoul(pending->substr(marker.size(), length));
+                    pending->erase(0, marker.size() + length + 1);
+                    return S_OK;
+                }
+
+            } else {
+                // Forward what cannot be the start of a marker.
+                size_t keep = pending->rfind(BATCH_RESULT_MARKER);
+                if ((keep == std::string::npos) || ((pending->size() - keep) >= marker.size())) {
+                    keep = pending->size();
+                }
+
+                Forward(GetStdHandle(STD_ERROR_HANDLE), pending, keep);
+            }
+
+            char buffer[4096];
+            DWORD bytesRead;
+            if ((!ReadFile(shellError, buffer, sizeof(buffer), &bytesRead, nullptr)) || (bytesRead == 0)) {
+                return HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE);
+            }
+
+            pending->append(buffer, bytesRead);
+        }
+    }
+
+    void Forward(HANDLE output, std::string* pending, size_t size)
+    {
+        DWORD written;
+        if (size > 0) {
+            WriteFile(output, pending->data(), (DWORD)size, &written, nullptr);
+            pending->erase(0, size);
+        }
+    }
+}
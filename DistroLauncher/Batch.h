@@ -0,0 +1,33 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+namespace Batch
+{
+    // The source of the commands that is read from stdin.
+    const std::wstring StdinSource = L"-";
+
+    // Run every command listed in source, one per line, in a single shell
+    // session and report the exit code and duration of each. Unless keepGoing
+    // is set, stop at the first command that fails. exitCode receives the exit
+    // code of the first command that failed, or 0.
+    HRESULT Run(std::wstring_view source, bool keepGoing, DWORD* exitCode);
+
+    // A command of a batch: the shell code it runs, in UTF-8, how it is
+    // reported and the name of its phase in the timings.
+    struct Command
+    {
+        std::string script;
+        std::wstring description;
+        PCSTR phase;
+    };
+
+    // Run commands in a single shell session, like Run.
+    HRESULT RunCommands(const std::vector<Command>& commands, bool keepGoing, DWORD* exitCode);
+
+    // Quote an argument so that the shell receives it unchanged.
+    std::string QuoteShellArgument(std::string_view argument);
+}
@@ -0,0 +1,189 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// The message table compiled from messages.mc.
+#define MESSAGE_TABLE_ID 1
+
+// Output is written out early past this many characters, even while batched.
+#define OUTPUT_FLUSH_SIZE 4096
+
+// The largest buffer FormatMessageW accepts, in characters.
+#define MESSAGE_MAX_SIZE (64 * 1024)
+
+namespace {
+    std::mutex g_lock;
+    const MESSAGE_RESOURCE_DATA* g_table = nullptr;
+    bool g_tableLoaded = false;
+    std::unordered_map<DWORD, std::wstring> g_messages;
+    std::wstring g_formatted;
+    std::wstring g_output;
+    std::string g_encoded;
+    unsigned int g_batchDepth = 0;
+    HANDLE g_handle = nullptr;
+    bool g_console = false;
+
+    const std::wstring* FindMessage(DWORD messageId);
+    void FlushLocked();
+}
+
+HRESULT Console::PrintMessageVa(DWORD messageId, va_list vaList)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    const std::wstring* format = FindMessage(messageId);
+    if (format == nullptr) {
+        return HRESULT_FROM_WIN32(ERROR_MR_MID_NOT_FOUND);
+    }
+
+    // The buffer is kept across messages, and only grows when a message does
+    // not fit.
+    if (g_formatted.empty()) {
+        g_formatted.resize(1024);
+    }
+
+    DWORD written;
+    for (;;) {
+        va_list arguments;
+        va_copy(arguments, vaList);
+        written = ::FormatMessageW(FORMAT_MESSAGE_FROM_STRING,
+                                   format->c_str(),
+                                   0,
+                                   0,
+                                   g_formatted.data(),
+                                   (DWORD)g_formatted.size(),
+                                   &arguments);
+        va_end(arguments);
+        if ((written > 0) ||
+            (GetLastError() != ERROR_INSUFFICIENT_BUFFER) ||
+            (g_formatted.size() >= MESSAGE_MAX_SIZE)) {
+            break;
+        }
+
+        g_formatted.resize(g_formatted.size() * 2);
+    }
+
+    if ((written == 0) && (!format->empty())) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    g_output.append(g_formatted.data(), written);
+    if ((g_batchDepth == 0) || (g_output.size() >= OUTPUT_FLUSH_SIZE)) {
+        FlushLocked();
+    }
+
+    return S_OK;
+}
+
+void Console::Write(std::wstring_view text)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    g_output += text;
+    if ((g_batchDepth == 0) || (g_output.size() >= OUTPUT_FLUSH_SIZE)) {
+        FlushLocked();
+    }
+}
+
+void Console::Flush()
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    FlushLocked();
+}
+
+Console::Batch::Batch()
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    g_batchDepth += 1;
+}
+
+Console::Batch::~Batch()
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    g_batchDepth -= 1;
+    if (g_batchDepth == 0) {
+        FlushLocked();
+    }
+}
+
+namespace {
+    const std::wstring* FindMessage(DWORD messageId)
+    {
+        const auto cached = g_messages.find(messageId);
+        if (cached != g_messages.end()) {
+            return &cached->second;
+        }
+
+        // The table is part of the image, so it stays mapped for the lifetime
+        // of the process.
+        if (!g_tableLoaded) {
+            g_tableLoaded = true;
+            HRSRC resource = FindResourceW(nullptr, MAKEINTRESOURCEW(MESSAGE_TABLE_ID), RT_MESSAGETABLE);
+            HGLOBAL data = (resource != nullptr) ? LoadResource(nullptr, resource) : nullptr;
+            g_table = (data != nullptr) ? static_cast<const MESSAGE_RESOURCE_DATA*>(LockResource(data)) : nullptr;
+        }
+
+        if (g_table == nullptr) {
+            return nullptr;
+        }
+
+        const BYTE* base = reinterpret_cast<const BYTE*>(g_table);
+        for (DWORD blockIndex = 0; blockIndex < g_table->NumberOfBlocks; blockIndex += 1) {
+            const MESSAGE_RESOURCE_BLOCK& block = g_table->Blocks[blockIndex];
+            if ((messageId < block.LowId) || (messageId > block.HighId)) {
+                continue;
+            }
+
+            const BYTE* entry = base + block.OffsetToEntries;
+            for (DWORD id = block.LowId; id < messageId; id += 1) {
+                entry += reinterpret_cast<const MESSAGE_RESOURCE_ENTRY*>(entry)->Length;
+            }
+
+            // Entries are padded with nulls, and may be stored in either the
+            // ANSI code page or UTF-16 depending on how the table was compiled.
+            const MESSAGE_RESOURCE_ENTRY* resourceEntry = reinterpret_cast<const MESSAGE_RESOURCE_ENTRY*>(entry);
+            const SIZE_T textSize = resourceEntry->Length - FIELD_OFFSET(MESSAGE_RESOURCE_ENTRY, Text);
+            std::wstring message;
+            if (resourceEntry->Flags & MESSAGE_RESOURCE_UNICODE) {
+                message.assign(reinterpret_cast<PCWSTR>(resourceEntry->Text), textSize / sizeof(WCHAR));
+
+            } else {
+                PCSTR text = reinterpret_cast<PCSTR>(resourceEntry->Text);
+                message.resize(MultiByteToWideChar(CP_ACP, 0, text, (int)textSize, nullptr, 0));
+                MultiByteToWideChar(CP_ACP, 0, text, (int)textSize, message.data(), (int)message.size());
+            }
+
+            message.resize(wcsnlen(message.c_str(), message.size()));
+            return &g_messages.emplace(messageId, std::move(message)).first->second;
+        }
+
+        return nullptr;
+    }
+
+    void FlushLocked()
+    {
+        if (g_output.empty()) {
+            return;
+        }
+
+        if (g_handle == nullptr) {
+            g_handle = GetStdHandle(STD_OUTPUT_HANDLE);
+            g_console = Helpers::IsConsoleHandle(g_handle);
+            atexit(Console::Flush);
+        }
+
+        DWORD written;
+        if (g_console) {
+            WriteConsoleW(g_handle, g_output.data(), (DWORD)g_output.size(), &written, nullptr);
+
+        } else {
+            g_encoded.resize(WideCharToMultiByte(CP_UTF8, 0, g_output.data(), (int)g_output.size(), nullptr, 0, nullptr, nullptr));
+            WideCharToMultiByte(CP_UTF8, 0, g_output.data(), (int)g_output.size(), g_encoded.data(), (int)g_encoded.size(), nullptr, nullptr);
+            WriteFile(g_handle, g_encoded.data(), (DWORD)g_encoded.size(), &written, nullptr);
+        }
+
+        // Keep the capacity for the next messages.
+        g_output.clear();
+    }
+}
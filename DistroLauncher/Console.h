@@ -0,0 +1,34 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+// Output of the launcher. Messages are formatted from a cache of the message
+// table into a reusable buffer, and written with WriteConsoleW to a console or
+// as UTF-8 to a redirected handle, so that frequent updates stay cheap.
+namespace Console
+{
+    // Format a message of the launcher and write it.
+    HRESULT PrintMessageVa(DWORD messageId, va_list vaList);
+
+    // Write text as is.
+    void Write(std::wstring_view text);
+
+    // Write out everything buffered so far.
+    void Flush();
+
+    // Output is written once per message, unless a batch is in progress: it
+    // is then written when the outermost batch ends, in as few writes as
+    // possible.
+    class Batch
+    {
+      public:
+        Batch();
+        ~Batch();
+
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+    };
+}
@@ -0,0 +1,82 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// Applies the delta given as a Windows path. Its manifest is checked against
+// the installed files before anything is changed, and the files the update
+// replaces or removes are backed up, so that they are put back if any step
+// fails. tar replaces each file with a new one rather than rewriting it, so
+// running programs keep the binaries and libraries they have mapped. The
+// removed paths are only deleted once the new files are in place.
+#define DELTA_APPLY_SCRIPT                                                                        \
+    L"set -e; "                                                                                   \
+    L"delta=$(wslpath -u \"$1\"); "                                                               \
+    L"stage=$(mktemp -d /var/tmp/delta.XXXXXX); "                                                 \
+    L"rollback() { set +e; "                                                                      \
+        L"xargs -r -d '\\n' rm -f -- < \"$stage/added\"; "                                        \
+        L"tar -C / -xpf \"$stage/backup.tar\"; }; "                                               \
+    L"trap 'status=$?; "                                                                          \
+        L"[ $status -eq 0 ] || [ ! -f \"$stage/backup.tar\" ] || rollback; "                      \
+        L"rm -rf \"$stage\"; exit $status' EXIT; "                                                \
+    L"tar -xpzf \"$delta\" -C \"$stage\" manifest; "                                              \
+    L"touch \"$stage/manifest/replaced\"; "                                                       \
+    L"cd /; "                                                                                     \
+    L"sha256sum --quiet --strict -c \"$stage/manifest/base.sha256\"; "                            \
+    L"tar -tzf \"$delta\" --quoting-style=literal | "                                             \
+        L"sed -n 's|^rootfs/\\(.*[^/]\\)$|./\\1|p' > \"$stage/new\"; "                            \
+    L"sed 's|^/|./|' \"$stage/manifest/replaced\" \"$stage/manifest/removed\" > \"$stage/old\"; " \
+    L"while IFS= read -r f; do "                                                                  \
+        L"if [ -e \"$f\" ] || [ -h \"$f\" ]; then printf '%s\\n' \"$f\" >&3; "                    \
+        L"else printf '%s\\n' \"$f\"; fi; "                                                       \
+        L"done < \"$stage/new\" > \"$stage/added\" 3> \"$stage/existing\"; "                      \
+    L"while IFS= read -r f; do "                                                                  \
+        L"if [ -e \"$f\" ] || [ -h \"$f\" ]; then printf '%s\\n' \"$f\"; fi; "                    \
+        L"done < \"$stage/old\" >> \"$stage/existing\"; "                                         \
+    L"tar -C / --no-recursion -cpf \"$stage/backup.tmp\" -T \"$stage/existing\"; "                \
+    L"mv \"$stage/backup.tmp\" \"$stage/backup.tar\"; "                                           \
+    L"sed 's|^/|./|' \"$stage/manifest/replaced\" | xargs -r -d '\\n' rm -rf --; "                \
+    L"tar -xpzf \"$delta\" -C / --strip-components=1 rootfs; "                                    \
+    L"sed 's|^/|./|' \"$stage/manifest/removed\" | xargs -r -d '\\n' rm -rf --; "                 \
+    L"sha256sum --quiet --strict -c \"$stage/manifest/target.sha256\""
+
+HRESULT DeltaUpdate::Apply(std::wstring_view deltaPath, DWORD* exitCode)
+{
+    Timings::Scope timing("update");
+
+    // The update runs from the root of the distribution, so the path to the
+    // delta cannot be relative to the current directory.
+    const std::wstring path(deltaPath);
+    std::wstring fullPath(MAX_PATH, L'\0');
+    DWORD length;
+    while ((length = GetFullPathNameW(path.c_str(), (DWORD)fullPath.size(), fullPath.data(), nullptr)) > fullPath.size()) {
+        fullPath.resize(length);
+    }
+
+    if (length == 0) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    fullPath.resize(length);
+    if (GetFileAttributesW(fullPath.c_str()) == INVALID_FILE_ATTRIBUTES) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    // The WSL API launches commands as the default user, which may not be
+    // allowed to change system files, so wsl.exe runs the update as root.
+    std::wstring arguments = L"--distribution ";
+    arguments += WslExe::QuoteArgument(DistributionInfo::Name);
+    arguments += L" --user root --exec /bin/sh -c ";
+    arguments += WslExe::QuoteArgument(DELTA_APPLY_SCRIPT);
+    arguments += L" sh ";
+    arguments += WslExe::QuoteArgument(fullPath);
+    HRESULT hr = WslExe::Run(arguments, exitCode);
+    timing.SetResult(hr);
+    return hr;
+}
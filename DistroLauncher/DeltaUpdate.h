@@ -0,0 +1,19 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+// A delta, created by "prepare-build make-delta", updates an installed
+// distribution in place from one rootfs to the next. It is a tarball of the
+// entries that were added or changed, along with the paths to remove and the
+// checksums of the files before and after the update.
+namespace DeltaUpdate
+{
+    // Apply the delta at deltaPath to the distribution, as root. The files it
+    // changes or removes must match the rootfs it was created from, or the
+    // distribution is left untouched. exitCode receives the exit code of the
+    // update, which is not 0 if any checksum did not match.
+    HRESULT Apply(std::wstring_view deltaPath, DWORD* exitCode);
+}
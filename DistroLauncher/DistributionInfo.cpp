@@ -5,74 +5,88 @@
 
 #include "stdafx.h"
 
-bool DistributionInfo::CreateUser(std::wstring_view userName)
+// Prefix of the line that reports the UID of the new user account.
+#define USER_UID_RESULT "uid="
+
+// How long looking up a UID may take, including booting the distribution.
+#define QUERY_UID_TIMEOUT (2 * 60 * 1000)
+
+namespace {
+    std::wstring QuoteShellArgument(std::wstring_view argument);
+}
+
+ULONG DistributionInfo::CreateUser(std::wstring_view userName)
 {
-    // Create the user account.
+    Timings::Scope timing("create-user");
+
+    // Create the user account, add it to any relevant groups and report its
+    // UID in a single launch. Everything the script runs writes to stderr so
+    // that the prompts of adduser reach the console; only the result is
+    // written to the original stdout. The user is deleted again if the groups
+    // cannot be added.
+    const std::wstring user = QuoteShellArgument(userName);
+    std::wstring script = L"exec 3>&1 1>&2; ";
+    script += L"adduser --quiet --gecos '' " + user + L" || exit 1; ";
+    script += L"if ! usermod -aG " + UserGroups + L" " + user + L"; then deluser " + user + L"; exit 1; fi; ";
+    script += L"echo " USER_UID_RESULT L"$(id -u " + user + L") >&3";
+
+    // There is no timeout, as adduser waits for the user to type a password.
+    std::string output;
     DWORD exitCode;
-    std::wstring commandLine = L"adduser --quiet --gecos '' ";
-    commandLine += userName;
-    HRESULT hr = g_wslApi.WslLaunchInteractive(commandLine.c_str(), true, &exitCode);
-    if ((FAILED(hr)) || (exitCode != 0)) {
-        return false;
+    HRESULT hr = g_wslApi.WslLaunchCapture(script.c_str(), true, GetStdHandle(STD_INPUT_HANDLE), &output, nullptr, INFINITE, nullptr, &exitCode);
+    if ((SUCCEEDED(hr)) && (exitCode != 0)) {
+        hr = E_FAIL;
     }
 
-    // Add the user account to any relevant groups.
-    commandLine = L"usermod -aG adm,dialout,cdrom,floppy,sudo,audio,dip,video,plugdev,netdev ";
-    commandLine += userName;
-    hr = g_wslApi.WslLaunchInteractive(commandLine.c_str(), true, &exitCode);
-    if ((FAILED(hr)) || (exitCode != 0)) {
-
-        // Delete the user if the group add command failed.
-        commandLine = L"deluser ";
-        commandLine += userName;
-        g_wslApi.WslLaunchInteractive(commandLine.c_str(), true, &exitCode);
-        return false;
+    ULONG uid = UID_INVALID;
+    const size_t result = output.rfind(USER_UID_RESULT);
+    if ((SUCCEEDED(hr)) && (result != std::string::npos)) {
+        try {
+            uid = std::stoul(output.substr(result + strlen(USER_UID_RESULT)), nullptr, 10);
+
+        } catch( ... ) { }
     }
 
-    return true;
+    timing.SetResult((uid == UID_INVALID) ? E_FAIL : S_OK);
+    return uid;
 }
 
 ULONG DistributionInfo::QueryUid(std::wstring_view userName)
 {
-    // Create a pipe to read the output of the launched process.
-    HANDLE readPipe;
-    HANDLE writePipe;
-    SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
+    Timings::Scope timing("query-uid");
+
+    // Query the UID of the supplied username.
+    std::wstring command = L"id -u ";
+    command += QuoteShellArgument(userName);
+    std::string output;
+    DWORD exitCode;
     ULONG uid = UID_INVALID;
-    if (CreatePipe(&readPipe, &writePipe, &sa, 0)) {
-        // Query the UID of the supplied username.
-        std::wstring command = L"id -u ";
-        command += userName;
-        int returnValue = 0;
-        HANDLE child;
-        HRESULT hr = g_wslApi.WslLaunch(command.c_str(), true, GetStdHandle(STD_INPUT_HANDLE), writePipe, GetStdHandle(STD_ERROR_HANDLE), &child);
-        if (SUCCEEDED(hr)) {
-            // Wait for the child to exit and ensure process exited successfully.
-            WaitForSingleObject(child, INFINITE);
-            DWORD exitCode;
-            if ((GetExitCodeProcess(child, &exitCode) == false) || (exitCode != 0)) {
-                hr = E_INVALIDARG;
-            }
+    HRESULT hr = g_wslApi.WslLaunchCapture(command.c_str(), true, GetStdHandle(STD_INPUT_HANDLE), &output, nullptr, QUERY_UID_TIMEOUT, nullptr, &exitCode);
+    if ((SUCCEEDED(hr)) && (exitCode == 0)) {
+        try {
+            uid = std::stoul(output, nullptr, 10);
 
-            CloseHandle(child);
-            if (SUCCEEDED(hr)) {
-                char buffer[64];
-                DWORD bytesRead;
+        } catch( ... ) { }
+    }
 
-                // Read the output of the command from the pipe and convert to a UID.
-                if (ReadFile(readPipe, buffer, (sizeof(buffer) - 1), &bytesRead, nullptr)) {
-                    buffer[bytesRead] = ANSI_NULL;
-                    try {
-                        uid = std::stoul(buffer, nullptr, 10);
+    timing.SetResult((uid == UID_INVALID) ? E_INVALIDARG : S_OK);
+    return uid;
+}
+
+namespace {
+    std::wstring QuoteShellArgument(std::wstring_view argument)
+    {
+        std::wstring quoted = L"'";
+        for (const wchar_t ch : argument) {
+            if (ch == L'\'') {
+                quoted += L"'\\''";
 
-                    } catch( ... ) { }
-                }
+            } else {
+                quoted += ch;
             }
         }
 
-        CloseHandle(readPipe);
-        CloseHandle(writePipe);
+        quoted += L"'";
+        return quoted;
     }
-
-    return uid;
 }
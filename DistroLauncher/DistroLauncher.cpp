@@ -8,47 +8,106 @@
 // Commandline arguments: 
 #define ARG_CONFIG              L"config"
 #define ARG_CONFIG_DEFAULT_USER L"--default-user"
+#define ARG_CONFIG_SHOW         L"--show"
 #define ARG_INSTALL             L"install"
 #define ARG_INSTALL_ROOT        L"--root"
+#define ARG_INSTALL_CONFIG      L"--config"
+#define ARG_INSTALL_FAST_FIRST_BOOT L"--fast-first-boot"
+#define ARG_INSTALL_FROM        L"--from"
+#define ARG_INSTALL_MANY        L"install-many"
+#define ARG_INSTALL_MANY_JOBS   L"--jobs"
 #define ARG_RUN                 L"run"
 #define ARG_RUN_C               L"-c"
+#define ARG_RUN_BATCH           L"--batch"
+#define ARG_RUN_KEEP_GOING      L"--keep-going"
 #define ARG_HELP                L"help"
+#define ARG_WARM                L"warm"
+#define ARG_WARM_IDLE           L"--idle"
+#define ARG_UPDATE              L"update"
+#define ARG_UPDATE_DELTA        L"--delta"
+#define ARG_MAINTAIN            L"maintain"
+#define ARG_MAINTAIN_COMPACT    L"--compact"
+#define ARG_EXPORT              L"export"
+
+// Global options, accepted before the command:
+#define ARG_TRACE_TIMINGS       L"--trace-timings"
+#define ARG_PROGRESS_JSON       L"--progress-json="
+
+// How long an instance waits for the install lock before saying that another
+// one is installing the distribution, rather than checking it is installed.
+#define INSTALL_LOCK_CHECK_TIMEOUT 100
 
 // Helper class for calling WSL Functions:
 // https://msdn.microsoft.com/en-us/library/windows/desktop/mt826874(v=vs.85).aspx
 WslApiLoader g_wslApi(DistributionInfo::Name);
 
-static HRESULT InstallDistribution(bool createUser);
+static HRESULT InstallDistribution(bool createUser, const Provision::Plan* plan, bool fastFirstBoot, std::wstring_view rootfsPath);
 static HRESULT SetDefaultUser(std::wstring_view userName);
+static HRESULT ShowConfiguration();
+static HRESULT RunCommand(PCWSTR command, DWORD* exitCode);
+static HANDLE AcquireInstallLock();
 
-HRESULT InstallDistribution(bool createUser)
+HRESULT InstallDistribution(bool createUser, const Provision::Plan* plan, bool fastFirstBoot, std::wstring_view rootfsPath)
 {
+    Timings::Scope timing("install");
+
     // Register the distribution.
     Helpers::PrintMessage(MSG_STATUS_INSTALLING);
-    HRESULT hr = g_wslApi.WslRegisterDistribution();
+    HRESULT hr;
+    {
+        Timings::Scope registerTiming("register");
+        hr = RootfsImport::RegisterDistribution(rootfsPath);
+        registerTiming.SetResult(hr);
+    }
+
     if (FAILED(hr)) {
+        timing.SetResult(hr);
         return hr;
     }
 
     // Delete /etc/resolv.conf to allow WSL to generate a version based on Windows networking information.
     DWORD exitCode;
-    hr = g_wslApi.WslLaunchInteractive(L"rm /etc/resolv.conf", true, &exitCode);
+    {
+        Timings::Scope resolvTiming("resolv.conf");
+        hr = g_wslApi.WslLaunchInteractive(L"rm /etc/resolv.conf", true, &exitCode);
+        resolvTiming.SetResult(hr);
+    }
+
     if (FAILED(hr)) {
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    if (fastFirstBoot) {
+        hr = FirstBoot::Prepare();
+        if (FAILED(hr)) {
+            timing.SetResult(hr);
+            return hr;
+        }
+    }
+
+    // A provisioning plan creates its own user account, if any.
+    if (plan != nullptr) {
+        hr = Provision::Apply(*plan);
+        timing.SetResult(hr);
         return hr;
     }
 
     // Create a user account.
     if (createUser) {
         Helpers::PrintMessage(MSG_CREATE_USER_PROMPT);
-        std::wstring userName;
+        ULONG uid;
         do {
-            userName = Helpers::GetUserInput(MSG_ENTER_USERNAME, 32);
+            std::wstring userName = Helpers::GetUserInput(MSG_ENTER_USERNAME, 32);
+            uid = DistributionInfo::CreateUser(userName);
 
-        } while (!DistributionInfo::CreateUser(userName));
+        } while (uid == UID_INVALID);
 
-        // Set this user account as the default.
-        hr = SetDefaultUser(userName);
+        // Set this user account as the default. The UID is already known, so
+        // there is no need to query it again.
+        hr = g_wslApi.WslConfigureDistribution(uid, WSL_DISTRIBUTION_FLAGS_DEFAULT);
         if (FAILED(hr)) {
+            timing.SetResult(hr);
             return hr;
         }
     }
@@ -58,18 +117,116 @@ HRESULT InstallDistribution(bool createUser)
 
 HRESULT SetDefaultUser(std::wstring_view userName)
 {
+    Timings::Scope timing("set-default-user");
+
+    // The current configuration is read from the registry, so that the
+    // flags are kept as they are and an unchanged user is not written again.
+    ULONG version;
+    ULONG currentUid;
+    WSL_DISTRIBUTION_FLAGS flags;
+    std::vector<std::string> environment;
+    HRESULT hr = g_wslApi.WslGetDistributionConfiguration(&version, &currentUid, &flags, &environment);
+    if (FAILED(hr)) {
+        timing.SetResult(hr);
+        return hr;
+    }
+
     // Query the UID of the given user name and configure the distribution
-    // to use this UID as the default.
-    ULONG uid = DistributionInfo::QueryUid(userName);
+    // to use this UID as the default. root is always UID 0, so it does not
+    // need the distribution to be started.
+    ULONG uid = (userName == L"root") ? 0 : DistributionInfo::QueryUid(userName);
     if (uid == UID_INVALID) {
+        timing.SetResult(E_INVALIDARG);
         return E_INVALIDARG;
     }
 
-    HRESULT hr = g_wslApi.WslConfigureDistribution(uid, WSL_DISTRIBUTION_FLAGS_DEFAULT);
+    if (uid == currentUid) {
+        return S_OK;
+    }
+
+    hr = g_wslApi.WslConfigureDistribution(uid, flags);
+    if (FAILED(hr)) {
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    return hr;
+}
+
+HRESULT ShowConfiguration()
+{
+    ULONG version;
+    ULONG uid;
+    WSL_DISTRIBUTION_FLAGS flags;
+    std::vector<std::string> environment;
+    HRESULT hr = g_wslApi.WslGetDistributionConfiguration(&version, &uid, &flags, &environment);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    Console::Batch batch;
+    Helpers::PrintMessage(MSG_CONFIG_SETTINGS, version, uid, (ULONG)flags);
+    for (const auto& variable : environment) {
+        Helpers::PrintMessage(MSG_CONFIG_ENVIRONMENT_VARIABLE, variable.c_str());
+    }
+
+    return hr;
+}
+
+HANDLE AcquireInstallLock()
+{
+    // Instances started at the same time, for instance by Terminal and by the
+    // user, must not race into registering the distribution: the first one
+    // installs it while holding this mutex, and the others block on it until
+    // the installation is complete. Every instance takes it to check the
+    // registration, which only holds it for a moment.
+    const std::wstring name = L"Local\\" + DistributionInfo::Name + L"-install";
+    HANDLE lock = CreateMutexW(nullptr, false, name.c_str());
+    if (lock == nullptr) {
+        return nullptr;
+    }
+
+    // A mutex abandoned by an instance that exited mid-install is still owned
+    // by the instance that got it, which then checks the registration again.
+    DWORD wait = WaitForSingleObject(lock, INSTALL_LOCK_CHECK_TIMEOUT);
+    if (wait == WAIT_TIMEOUT) {
+        Timings::Scope timing("install-wait");
+        Helpers::PrintMessage(MSG_INSTALL_WAITING);
+        wait = WaitForSingleObject(lock, INFINITE);
+    }
+
+    if ((wait != WAIT_OBJECT_0) && (wait != WAIT_ABANDONED)) {
+        CloseHandle(lock);
+        return nullptr;
+    }
+
+    return lock;
+}
+
+HRESULT RunCommand(PCWSTR command, DWORD* exitCode)
+{
+    // Interactive sessions attach to the console. When stdin or stdout is
+    // redirected, the standard handles are passed straight to the Linux
+    // process instead, so that bulk data flows between the file or pipe and
+    // the distribution without going through the console.
+    const HANDLE stdIn = GetStdHandle(STD_INPUT_HANDLE);
+    const HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if ((Helpers::IsConsoleHandle(stdIn)) && (Helpers::IsConsoleHandle(stdOut))) {
+        return g_wslApi.WslLaunchInteractive(command, true, exitCode);
+    }
+
+    HANDLE process;
+    HRESULT hr = g_wslApi.WslLaunch(command, true, stdIn, stdOut, GetStdHandle(STD_ERROR_HANDLE), &process);
     if (FAILED(hr)) {
         return hr;
     }
 
+    WaitForSingleObject(process, INFINITE);
+    if (!GetExitCodeProcess(process, exitCode)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    CloseHandle(process);
     return hr;
 }
 
@@ -88,13 +245,18 @@ int DebugReportHook(int reportType, char *message, int *returnValue)
         }
     }();
 
-    std::cerr << type << " " << message;
+    // Written directly, so that the CRT streams are never initialized.
+    DWORD written;
+    const HANDLE error = GetStdHandle(STD_ERROR_HANDLE);
+    const std::string report = std::string(type) + " " + message;
+    WriteFile(error, report.data(), (DWORD)report.size(), &written, nullptr);
     exit(EXIT_FAILURE);
 }
 
 int wmain(int argc, wchar_t const *argv[])
 {
     _CrtSetReportHook(DebugReportHook);
+    Timings::RegisterProvider();
 
     // Update the title bar of the console window.
     SetConsoleTitleW(DistributionInfo::WindowTitle.c_str());
@@ -105,6 +267,28 @@ int wmain(int argc, wchar_t const *argv[])
         arguments.push_back(argv[index]);
     }
 
+    // Parse global options, which precede the command.
+    while (!arguments.empty()) {
+        const std::wstring_view option = arguments.front();
+        if (option == ARG_TRACE_TIMINGS) {
+            Timings::Enable(L"");
+
+        } else if (option.substr(0, wcslen(ARG_TRACE_TIMINGS L"=")) == ARG_TRACE_TIMINGS L"=") {
+            Timings::Enable(option.substr(wcslen(ARG_TRACE_TIMINGS L"=")));
+
+        } else if ((option.substr(0, wcslen(ARG_PROGRESS_JSON)) == ARG_PROGRESS_JSON) && (option.size() > wcslen(ARG_PROGRESS_JSON))) {
+            InstallProgress::EnableJson(option.substr(wcslen(ARG_PROGRESS_JSON)));
+
+        } else {
+            break;
+        }
+
+        arguments.erase(arguments.begin());
+    }
+
+    Timings::TraceCommand(arguments.empty() ? std::wstring_view(L"") : arguments.front());
+    Timings::Scope timing("wmain");
+
     // Deal with possible help flag.
     if (!arguments.empty() && arguments.front() == ARG_HELP) {
         Helpers::PrintMessage(MSG_USAGE);
@@ -122,14 +306,190 @@ int wmain(int argc, wchar_t const *argv[])
         return exitCode;
     }
 
+    // Warming the distribution up never installs it.
+    if ((!arguments.empty()) && (arguments[0] == ARG_WARM)) {
+        ULONG idleSeconds = Warm::DefaultIdleSeconds;
+        if ((arguments.size() == 3) && (arguments[1] == ARG_WARM_IDLE)) {
+            try {
+                idleSeconds = std::stoul(std::wstring(arguments[2]), nullptr, 10);
+
+            } catch( ... ) {
+                Helpers::PrintMessage(MSG_USAGE);
+                return exitCode;
+            }
+
+        } else if (arguments.size() != 1) {
+            Helpers::PrintMessage(MSG_USAGE);
+            return exitCode;
+        }
+
+        if (!g_wslApi.WslIsDistributionRegistered()) {
+            Helpers::PrintMessage(MSG_WARM_NOT_INSTALLED);
+            return exitCode;
+        }
+
+        // The startup task of the package runs warm at login in a console of
+        // its own, which is closed rather than left open for the idle window.
+        DWORD consoleProcess;
+        if (GetConsoleProcessList(&consoleProcess, 1) == 1) {
+            FreeConsole();
+        }
+
+        HRESULT hr = Warm::Run(idleSeconds);
+        if (FAILED(hr)) {
+            Helpers::PrintErrorMessage(hr);
+        }
+
+        return SUCCEEDED(hr) ? 0 : 1;
+    }
+
+    // Updates only apply to an installed distribution.
+    if ((!arguments.empty()) && (arguments[0] == ARG_UPDATE)) {
+        if ((arguments.size() != 3) || (arguments[1] != ARG_UPDATE_DELTA)) {
+            Helpers::PrintMessage(MSG_USAGE);
+            return exitCode;
+        }
+
+        if (!g_wslApi.WslIsDistributionRegistered()) {
+            Helpers::PrintMessage(MSG_UPDATE_NOT_INSTALLED);
+            return exitCode;
+        }
+
+        HRESULT hr = DeltaUpdate::Apply(arguments[2], &exitCode);
+        if (FAILED(hr)) {
+            Helpers::PrintErrorMessage(hr);
+            return 1;
+        }
+
+        Helpers::PrintMessage((exitCode == 0) ? MSG_UPDATE_DONE : MSG_UPDATE_FAILED, exitCode);
+        return exitCode;
+    }
+
+    // So does maintenance.
+    if ((!arguments.empty()) && (arguments[0] == ARG_MAINTAIN)) {
+        if ((arguments.size() != 2) || (arguments[1] != ARG_MAINTAIN_COMPACT)) {
+            Helpers::PrintMessage(MSG_USAGE);
+            return exitCode;
+        }
+
+        if (!g_wslApi.WslIsDistributionRegistered()) {
+            Helpers::PrintMessage(MSG_MAINTAIN_NOT_INSTALLED);
+            return exitCode;
+        }
+
+        HRESULT hr = Maintain::Compact();
+        if (FAILED(hr)) {
+            Helpers::PrintErrorMessage(hr);
+        }
+
+        return SUCCEEDED(hr) ? 0 : 1;
+    }
+
+    // And so does exporting it.
+    if ((!arguments.empty()) && (arguments[0] == ARG_EXPORT)) {
+        if (arguments.size() != 2) {
+            Helpers::PrintMessage(MSG_USAGE);
+            return exitCode;
+        }
+
+        if (!g_wslApi.WslIsDistributionRegistered()) {
+            Helpers::PrintMessage(MSG_EXPORT_NOT_INSTALLED);
+            return exitCode;
+        }
+
+        HRESULT hr = Export::Run(arguments[1]);
+        if (FAILED(hr)) {
+            Helpers::PrintErrorMessage(hr);
+        }
+
+        return SUCCEEDED(hr) ? 0 : 1;
+    }
+
+    // The distributions of other launchers are installed by the launchers
+    // themselves, so this one is left as it is.
+    if ((!arguments.empty()) && (arguments[0] == ARG_INSTALL_MANY)) {
+        unsigned int jobs = ParallelInstall::DefaultJobs();
+        size_t first = 1;
+        if ((arguments.size() > 2) && (arguments[1] == ARG_INSTALL_MANY_JOBS)) {
+            try {
+                jobs = std::stoul(std::wstring(arguments[2]), nullptr, 10);
+
+            } catch( ... ) {
+                jobs = 0;
+            }
+
+            first = 3;
+        }
+
+        if ((jobs == 0) || (arguments.size() <= first)) {
+            Helpers::PrintMessage(MSG_USAGE);
+            return exitCode;
+        }
+
+        const std::vector<std::wstring_view> launchers(arguments.begin() + first, arguments.end());
+        HRESULT hr = ParallelInstall::Run(launchers, jobs, &exitCode);
+        if (FAILED(hr)) {
+            Helpers::PrintErrorMessage(hr);
+        }
+
+        return SUCCEEDED(hr) ? exitCode : 1;
+    }
+
     // Install the distribution if it is not already.
     bool installOnly = ((arguments.size() > 0) && (arguments[0] == ARG_INSTALL));
     HRESULT hr = S_OK;
-    if (!g_wslApi.WslIsDistributionRegistered()) {
 
-        // If the "--root" option is specified, do not create a user account.
-        bool useRoot = ((installOnly) && (arguments.size() > 1) && (arguments[1] == ARG_INSTALL_ROOT));
-        hr = InstallDistribution(!useRoot);
+    // Parse the options of install. If the "--root" option is specified, do
+    // not create a user account. A restored backup already has its accounts.
+    bool useRoot = false;
+    bool fastFirstBoot = false;
+    std::wstring_view configPath;
+    std::wstring_view rootfsPath;
+    for (size_t index = 1; (installOnly) && (index < arguments.size()); index += 1) {
+        if (arguments[index] == ARG_INSTALL_ROOT) {
+            useRoot = true;
+
+        } else if (arguments[index] == ARG_INSTALL_FAST_FIRST_BOOT) {
+            fastFirstBoot = true;
+
+        } else if ((arguments[index] == ARG_INSTALL_CONFIG) && (index + 1 < arguments.size())) {
+            index += 1;
+            configPath = arguments[index];
+
+        } else if ((arguments[index] == ARG_INSTALL_FROM) && (index + 1 < arguments.size())) {
+            index += 1;
+            rootfsPath = arguments[index];
+            useRoot = true;
+
+        } else {
+            Helpers::PrintMessage(MSG_USAGE);
+            return exitCode;
+        }
+    }
+
+    // The provisioning file is checked before anything is installed.
+    Provision::Plan plan;
+    const bool provision = (!configPath.empty());
+    if (provision) {
+        hr = Provision::Load(configPath, &plan);
+        if (hr == E_INVALIDARG) {
+            return exitCode;
+        }
+
+        if (FAILED(hr)) {
+            Helpers::PrintErrorMessage(hr);
+            return exitCode;
+        }
+    }
+
+    // The distribution is registered well before the instance installing it
+    // is done setting it up, so the registration is only trusted once the
+    // lock is free. Another instance may have installed the distribution
+    // while this one was waiting, in which case it can be used right away.
+    HANDLE installLock = AcquireInstallLock();
+    bool installIgnored = false;
+    if (!g_wslApi.WslIsDistributionRegistered()) {
+        hr = InstallDistribution(!useRoot, provision ? &plan : nullptr, fastFirstBoot, rootfsPath);
         if (FAILED(hr)) {
             if (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS)) {
                 Helpers::PrintMessage(MSG_INSTALL_ALREADY_EXISTS);
@@ -140,6 +500,22 @@ int wmain(int argc, wchar_t const *argv[])
         }
 
         exitCode = SUCCEEDED(hr) ? 0 : 1;
+
+    } else if ((provision) || (fastFirstBoot) || (!rootfsPath.empty())) {
+
+        // These options only apply to a new installation, which must not look
+        // restored or provisioned when it was left as it is.
+        Helpers::PrintMessage(MSG_INSTALL_ALREADY_EXISTS);
+        installIgnored = true;
+    }
+
+    if (installLock != nullptr) {
+        ReleaseMutex(installLock);
+        CloseHandle(installLock);
+    }
+
+    if (installIgnored) {
+        return 1;
     }
 
     // Parse the command line arguments.
@@ -153,6 +529,15 @@ int wmain(int argc, wchar_t const *argv[])
                 Helpers::PromptForInput();
             }
 
+        } else if ((arguments[0] == ARG_RUN) && (arguments.size() > 1) && (arguments[1] == ARG_RUN_BATCH)) {
+            const bool keepGoing = ((arguments.size() == 4) && (arguments[3] == ARG_RUN_KEEP_GOING));
+            if ((arguments.size() != 3) && (!keepGoing)) {
+                Helpers::PrintMessage(MSG_USAGE);
+                return exitCode;
+            }
+
+            hr = Batch::Run(arguments[2], keepGoing, &exitCode);
+
         } else if ((arguments[0] == ARG_RUN) ||
                    (arguments[0] == ARG_RUN_C)) {
 
@@ -162,7 +547,7 @@ int wmain(int argc, wchar_t const *argv[])
                 command += arguments[index];
             }
 
-            hr = g_wslApi.WslLaunchInteractive(command.c_str(), true, &exitCode);
+            hr = RunCommand(command.c_str(), &exitCode);
 
         } else if (arguments[0] == ARG_CONFIG) {
             hr = E_INVALIDARG;
@@ -170,6 +555,11 @@ int wmain(int argc, wchar_t const *argv[])
                 if (arguments[1] == ARG_CONFIG_DEFAULT_USER) {
                     hr = SetDefaultUser(arguments[2]);
                 }
+
+            } else if (arguments.size() == 2) {
+                if (arguments[1] == ARG_CONFIG_SHOW) {
+                    hr = ShowConfiguration();
+                }
             }
 
             if (SUCCEEDED(hr)) {
@@ -0,0 +1,127 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// The file system of the distribution, without what is mounted on it, with
+// everything wsl --export keeps. tar reports files that changed while they
+// were read with exit code 1, which still makes a usable backup.
+#define EXPORT_TAR_ARGUMENTS L"tar --create --file=- --directory=/ --one-file-system --numeric-owner --acls --xattrs --xattrs-include=* --sparse ."
+#define EXPORT_TAR_WARNING 1
+
+// Size of the pipe buffer between tar and the compression.
+#define EXPORT_PIPE_BUFFER_SIZE (1024 * 1024)
+
+// How often the progress is reported, in milliseconds.
+#define EXPORT_PROGRESS_INTERVAL_MS 1000
+
+#define BYTES_PER_MB (1024 * 1024)
+
+HRESULT Export::Run(std::wstring_view destinationPath)
+{
+    Timings::Scope timing("export");
+    const std::wstring destination(destinationPath);
+    const std::wstring partial = destination + L".partial";
+    HANDLE output = CreateFileW(partial.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (output == INVALID_HANDLE_VALUE) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    // Only the end tar writes to is inherited.
+    HRESULT hr = S_OK;
+    SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
+    HANDLE input = nullptr;
+    HANDLE tarOutput = nullptr;
+    HANDLE process = nullptr;
+    if ((!CreatePipe(&input, &tarOutput, &sa, EXPORT_PIPE_BUFFER_SIZE)) ||
+        (!SetHandleInformation(input, HANDLE_FLAG_INHERIT, 0))) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // The WSL API launches commands as the default user, who may not be
+    // allowed to read every file, so wsl.exe runs tar as root.
+    if (SUCCEEDED(hr)) {
+        std::wstring arguments = L"--distribution ";
+        arguments += WslExe::QuoteArgument(DistributionInfo::Name);
+        arguments += L" --user root --exec " EXPORT_TAR_ARGUMENTS;
+        hr = WslExe::Launch(arguments, tarOutput, &process);
+    }
+
+    // Close our copy of the write end so that reading stops once tar exits.
+    if (tarOutput != nullptr) {
+        CloseHandle(tarOutput);
+    }
+
+    const ULONGLONG start = GetTickCount64();
+    const bool console = Helpers::IsConsoleHandle(GetStdHandle(STD_OUTPUT_HANDLE));
+    ULONGLONG nextReport = start + EXPORT_PROGRESS_INTERVAL_MS;
+    bool printed = false;
+    ULONGLONG bytesRead = 0;
+    ULONGLONG bytesWritten = 0;
+    if (SUCCEEDED(hr)) {
+        hr = PackedRootfs::Encode(input, output, [&](ULONGLONG read, ULONGLONG written) {
+            bytesRead = read;
+            bytesWritten = written;
+            const ULONGLONG now = GetTickCount64();
+            if ((console) && (now >= nextReport)) {
+                const ULONGLONG bytesPerSecond = (read * 1000) / std::max<ULONGLONG>(1, now - start);
+                Helpers::PrintMessage(MSG_EXPORT_PROGRESS, (ULONG)(read / BYTES_PER_MB), (ULONG)(written / BYTES_PER_MB), (ULONG)(bytesPerSecond / BYTES_PER_MB));
+                nextReport = now + EXPORT_PROGRESS_INTERVAL_MS;
+                printed = true;
+            }
+        });
+
+        // The console line that was updated in place is ended first.
+        if (printed) {
+            Helpers::PrintMessage(MSG_INSTALL_PROGRESS_END);
+        }
+    }
+
+    // Closing the read end stops tar if the backup could not be written.
+    if (input != nullptr) {
+        CloseHandle(input);
+    }
+
+    if (process != nullptr) {
+        DWORD exitCode = 0;
+        WaitForSingleObject(process, INFINITE);
+        if (!GetExitCodeProcess(process, &exitCode)) {
+            hr = SUCCEEDED(hr) ? HRESULT_FROM_WIN32(GetLastError()) : hr;
+
+        } else if ((SUCCEEDED(hr)) && (exitCode != 0) && (exitCode != EXPORT_TAR_WARNING)) {
+            Helpers::PrintMessage(MSG_EXPORT_TAR_FAILED, exitCode);
+            hr = E_FAIL;
+        }
+
+        CloseHandle(process);
+    }
+
+    if ((SUCCEEDED(hr)) && (!FlushFileBuffers(output))) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    CloseHandle(output);
+    if ((SUCCEEDED(hr)) && (!MoveFileExW(partial.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED))) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (FAILED(hr)) {
+        DeleteFileW(partial.c_str());
+
+    } else {
+        const ULONGLONG elapsed = std::max<ULONGLONG>(1, GetTickCount64() - start);
+        Helpers::PrintMessage(MSG_EXPORT_DONE,
+                              (ULONG)(bytesRead / BYTES_PER_MB),
+                              (ULONG)(bytesWritten / BYTES_PER_MB),
+                              destination.c_str(),
+                              (ULONG)(elapsed / 1000),
+                              (ULONG)(((bytesRead * 1000) / elapsed) / BYTES_PER_MB));
+    }
+
+    timing.SetResult(hr);
+    return hr;
+}
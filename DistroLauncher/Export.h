@@ -0,0 +1,16 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+namespace Export
+{
+    // Back the file system of the distribution up to destinationPath as a
+    // packed rootfs, which "install --from" restores. The tarball is streamed
+    // out of the distribution and compressed on every core as it arrives, so
+    // it is never written to disk uncompressed. The backup only replaces
+    // destinationPath once it is complete.
+    HRESULT Run(std::wstring_view destinationPath);
+}
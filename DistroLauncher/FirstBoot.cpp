@@ -0,0 +1,34 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// Runs as root right after registration. Locales are generated now rather
+// than on first use, man-db no longer rebuilds its index on every package
+// trigger, snapd is left to its socket so that it seeds when a snap command
+// first needs it, and boot does not wait for a network that WSL provides.
+// Steps that do not apply to the rootfs are skipped.
+#define FIRST_BOOT_SCRIPT                                                                           \
+    L"if [ -x /usr/sbin/locale-gen ]; then locale-gen --keep-existing >/dev/null; fi; "             \
+    L"rm -f /var/lib/man-db/auto-update; "                                                          \
+    L"echo 'man-db man-db/auto-update boolean false' | debconf-set-selections 2>/dev/null; "        \
+    L"if command -v systemctl >/dev/null; then "                                                    \
+    L"systemctl disable snapd.service snapd.seeded.service 2>/dev/null; "                           \
+    L"systemctl mask systemd-networkd-wait-online.service 2>/dev/null; "                            \
+    L"fi; "                                                                                         \
+    L"true"
+
+HRESULT FirstBoot::Prepare()
+{
+    Timings::Scope timing("fast-first-boot");
+    DWORD exitCode;
+    HRESULT hr = g_wslApi.WslLaunchInteractive(FIRST_BOOT_SCRIPT, true, &exitCode);
+    if ((SUCCEEDED(hr)) && (exitCode != 0)) {
+        hr = E_FAIL;
+    }
+
+    timing.SetResult(hr);
+    return hr;
+}
@@ -0,0 +1,14 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+namespace FirstBoot
+{
+    // Do at install time what the first boot of the distribution would
+    // otherwise do, and defer what the first shell does not need, so that it
+    // opens as fast as the later ones.
+    HRESULT Prepare();
+}
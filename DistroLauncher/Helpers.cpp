@@ -5,9 +5,41 @@
 
 #include "stdafx.h"
 
-namespace {
-    HRESULT FormatMessageHelperVa(DWORD messageId, va_list vaList, std::wstring* message);
-    HRESULT PrintMessageVa(DWORD messageId, va_list vaList);
+std::wstring Helpers::GetModuleDirectory()
+{
+    // The launcher lives at the root of the package, next to the rootfs.
+    std::wstring path(MAX_PATH, L'\0');
+    DWORD length;
+    while ((length = GetModuleFileNameW(nullptr, path.data(), (DWORD)path.size())) == path.size()) {
+        path.resize(path.size() * 2);
+    }
+
+    path.resize(length);
+    return path.substr(0, path.find_last_of(L'\\'));
+}
+
+std::wstring Helpers::GetLocalStateDirectory()
+{
+    // The package data folder, where WslRegisterDistribution also puts the
+    // disk of the distribution. Empty when the launcher is not packaged.
+    UINT32 length = 0;
+    if (GetCurrentPackageFamilyName(&length, nullptr) != ERROR_INSUFFICIENT_BUFFER) {
+        return L"";
+    }
+
+    std::wstring familyName(length, L'\0');
+    if (GetCurrentPackageFamilyName(&length, familyName.data()) != ERROR_SUCCESS) {
+        return L"";
+    }
+
+    familyName.resize(length - 1);
+    std::wstring localAppData(MAX_PATH, L'\0');
+    localAppData.resize(GetEnvironmentVariableW(L"LOCALAPPDATA", localAppData.data(), (DWORD)localAppData.size()));
+    if ((localAppData.empty()) || (localAppData.size() >= MAX_PATH)) {
+        return L"";
+    }
+
+    return localAppData + L"\\Packages\\" + familyName + L"\\LocalState";
 }
 
 std::wstring Helpers::GetUserInput(DWORD promptMsg, DWORD maxCharacters)
@@ -30,6 +62,12 @@ std::wstring Helpers::GetUserInput(DWORD promptMsg, DWORD maxCharacters)
     return input;
 }
 
+bool Helpers::IsConsoleHandle(HANDLE handle)
+{
+    DWORD mode;
+    return ((GetFileType(handle) == FILE_TYPE_CHAR) && (GetConsoleMode(handle, &mode)));
+}
+
 void Helpers::PrintErrorMessage(HRESULT error)
 {
     PWSTR buffer = nullptr; 
@@ -53,7 +91,7 @@ HRESULT Helpers::PrintMessage(DWORD messageId, ...)
 {
     va_list argList;
     va_start(argList, messageId);
-    HRESULT hr = PrintMessageVa(messageId, argList);
+    HRESULT hr = Console::PrintMessageVa(messageId, argList);
     va_end(argList);
     return hr;
 }
@@ -64,34 +102,3 @@ void Helpers::PromptForInput()
     _getwch();
     return;
 }
-
-namespace {
-    HRESULT FormatMessageHelperVa(DWORD messageId, va_list vaList, std::wstring* message)
-    {
-        PWSTR buffer = nullptr; 
-        DWORD written = ::FormatMessageW(FORMAT_MESSAGE_FROM_HMODULE | FORMAT_MESSAGE_ALLOCATE_BUFFER,
-                                         nullptr,
-                                         messageId,
-                                         0,
-                                         (PWSTR)&buffer,
-                                         10,
-                                         &vaList);
-        *message = buffer;
-        if (buffer != nullptr) {
-            HeapFree(GetProcessHeap(), 0, buffer);
-        }
-
-        return (written > 0) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
-    }
-
-    HRESULT PrintMessageVa(DWORD messageId, va_list vaList)
-    {
-        std::wstring message;
-        HRESULT hr = FormatMessageHelperVa(messageId, vaList, &message);
-        if (SUCCEEDED(hr)) {
-            wprintf(L"%ls", message.c_str());
-        }
-
-        return hr;
-    }
-}
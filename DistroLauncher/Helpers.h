@@ -9,7 +9,10 @@
 
 namespace Helpers
 {
+    std::wstring GetModuleDirectory();
+    std::wstring GetLocalStateDirectory();
     std::wstring GetUserInput(DWORD promptMsg, DWORD maxCharacters);
+    bool IsConsoleHandle(HANDLE handle);
     void PrintErrorMessage(HRESULT hr);
     HRESULT PrintMessage(DWORD messageId, ...);
     void PromptForInput();
@@ -0,0 +1,209 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// How often the progress is reported, in milliseconds.
+#define PROGRESS_INTERVAL_MS 1000
+
+#define TAR_BLOCK_SIZE 512
+
+namespace {
+    // The state of the import, updated by the thread that feeds it and read
+    // by the reporting thread.
+    std::wstring g_jsonPath;
+    HANDLE g_json = INVALID_HANDLE_VALUE;
+    ULONGLONG g_totalBytes = 0;
+    ULONGLONG g_startTime = 0;
+    std::atomic<ULONGLONG> g_bytes{0};
+    std::atomic<ULONGLONG> g_files{0};
+    std::atomic<bool> g_countFiles{false};
+    bool g_console = false;
+    bool g_printed = false;
+    std::thread g_reporter;
+    std::mutex g_lock;
+    std::condition_variable g_stopped;
+    bool g_running = false;
+
+    // Where the tarball parser is: the bytes left until the next header and
+    // the part of the header received so far.
+    ULONGLONG g_tarSkip = 0;
+    BYTE g_tarHeader[TAR_BLOCK_SIZE];
+    SIZE_T g_tarHeaderSize = 0;
+
+    void Report(bool done, HRESULT result);
+    void CountFiles(const BYTE* tar, SIZE_T tarSize);
+    ULONGLONG ParseTarSize(const BYTE* field, SIZE_T fieldSize);
+}
+
+void InstallProgress::EnableJson(std::wstring_view path)
+{
+    g_jsonPath = path;
+}
+
+void InstallProgress::Start(ULONGLONG totalBytes)
+{
+    g_totalBytes = totalBytes;
+    g_startTime = GetTickCount64();
+    g_bytes = 0;
+    g_files = 0;
+    g_countFiles = false;
+    g_tarSkip = 0;
+    g_tarHeaderSize = 0;
+    g_console = Helpers::IsConsoleHandle(GetStdHandle(STD_OUTPUT_HANDLE));
+    g_printed = false;
+    if (!g_jsonPath.empty()) {
+        g_json = CreateFileW(g_jsonPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (g_json == INVALID_HANDLE_VALUE) {
+            Helpers::PrintMessage(MSG_PROGRESS_WRITE_FAILED, g_jsonPath.c_str(), HRESULT_FROM_WIN32(GetLastError()));
+        }
+    }
+
+    g_running = true;
+    g_reporter = std::thread([] {
+        std::unique_lock<std::mutex> lock(g_lock);
+        while (!g_stopped.wait_for(lock, std::chrono::milliseconds(PROGRESS_INTERVAL_MS), [] { return !g_running; })) {
+            Report(false, S_OK);
+        }
+    });
+}
+
+void InstallProgress::Advance(ULONGLONG sourceBytes, const BYTE* tar, SIZE_T tarSize)
+{
+    if (tar != nullptr) {
+        g_countFiles = true;
+        CountFiles(tar, tarSize);
+    }
+
+    g_bytes += sourceBytes;
+}
+
+void InstallProgress::Stop(HRESULT result)
+{
+    if (!g_reporter.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        g_running = false;
+    }
+
+    g_stopped.notify_all();
+    g_reporter.join();
+    Report(true, result);
+    if (g_json != INVALID_HANDLE_VALUE) {
+        CloseHandle(g_json);
+        g_json = INVALID_HANDLE_VALUE;
+    }
+}
+
+namespace {
+    void Report(bool done, HRESULT result)
+    {
+        const ULONGLONG bytes = g_bytes;
+        const ULONGLONG files = g_files;
+        const ULONGLONG elapsed = std::max<ULONGLONG>(1, GetTickCount64() - g_startTime);
+        const ULONGLONG bytesPerSecond = (bytes * 1000) / elapsed;
+        const ULONGLONG remaining = (g_totalBytes > bytes) ? (g_totalBytes - bytes) : 0;
+        const ULONGLONG eta = (bytes > 0) ? ((remaining * elapsed) / bytes) : 0;
+        const ULONG megabyte = 1024 * 1024;
+        if (done) {
+            // The console line that was updated in place is ended first.
+            if (g_printed) {
+                Helpers::PrintMessage(MSG_INSTALL_PROGRESS_END);
+            }
+
+            Helpers::PrintMessage(MSG_INSTALL_PROGRESS_DONE, (ULONG)(bytes / megabyte), (ULONG)(elapsed / 1000), (ULONG)(bytesPerSecond / megabyte));
+
+        } else if (g_console) {
+            g_printed = true;
+            if (g_countFiles) {
+                Helpers::PrintMessage(MSG_INSTALL_PROGRESS_FILES, (ULONG)(bytes / megabyte), (ULONG)(g_totalBytes / megabyte), (ULONG)(bytesPerSecond / megabyte), (ULONG)files, (ULONG)(eta / 1000));
+
+            } else {
+                Helpers::PrintMessage(MSG_INSTALL_PROGRESS, (ULONG)(bytes / megabyte), (ULONG)(g_totalBytes / megabyte), (ULONG)(bytesPerSecond / megabyte), (ULONG)(eta / 1000));
+            }
+        }
+
+        if (g_json == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        char resultText[11];
+        sprintf_s(resultText, "0x%08lx", (ULONG)result);
+        std::string json = "{\"bytes\":" + std::to_string(bytes);
+        json += ",\"total_bytes\":" + std::to_string(g_totalBytes);
+        json += g_countFiles ? (",\"files\":" + std::to_string(files)) : std::string();
+        json += ",\"elapsed_ms\":" + std::to_string(elapsed);
+        json += ",\"bytes_per_second\":" + std::to_string(bytesPerSecond);
+        json += ",\"eta_ms\":" + std::to_string(done ? 0 : eta);
+        json += ",\"done\":" + std::string(done ? "true" : "false");
+        json += done ? (",\"result\":\"" + std::string(resultText) + "\"}\n") : std::string("}\n");
+        DWORD written;
+        WriteFile(g_json, json.data(), (DWORD)json.size(), &written, nullptr);
+    }
+
+    void CountFiles(const BYTE* tar, SIZE_T tarSize)
+    {
+        while (tarSize > 0) {
+            if (g_tarSkip > 0) {
+                const SIZE_T skipped = (SIZE_T)std::min<ULONGLONG>(g_tarSkip, tarSize);
+                g_tarSkip -= skipped;
+                tar += skipped;
+                tarSize -= skipped;
+                continue;
+            }
+
+            const SIZE_T copied = std::min<SIZE_T>(TAR_BLOCK_SIZE - g_tarHeaderSize, tarSize);
+            memcpy(g_tarHeader + g_tarHeaderSize, tar, copied);
+            g_tarHeaderSize += copied;
+            tar += copied;
+            tarSize -= copied;
+            if (g_tarHeaderSize < TAR_BLOCK_SIZE) {
+                break;
+            }
+
+            // The archive ends with empty blocks. Long names and pax headers
+            // describe the entry that follows them, so they are not counted.
+            g_tarHeaderSize = 0;
+            if (std::all_of(g_tarHeader, g_tarHeader + TAR_BLOCK_SIZE, [](BYTE value) { return value == 0; })) {
+                continue;
+            }
+
+            const char type = (char)g_tarHeader[156];
+            if ((type != 'L') && (type != 'K') && (type != 'x') && (type != 'g')) {
+                g_files += 1;
+            }
+
+            const ULONGLONG size = ParseTarSize(g_tarHeader + 124, 12);
+            g_tarSkip = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+        }
+    }
+
+    ULONGLONG ParseTarSize(const BYTE* field, SIZE_T fieldSize)
+    {
+        // Sizes are octal, or big-endian binary when the high bit is set.
+        ULONGLONG size = 0;
+        if ((field[0] & 0x80) != 0) {
+            for (SIZE_T index = 1; index < fieldSize; index += 1) {
+                size = (size << 8) | field[index];
+            }
+
+            return size;
+        }
+
+        for (SIZE_T index = 0; index < fieldSize; index += 1) {
+            if ((field[index] >= '0') && (field[index] <= '7')) {
+                size = (size * 8) + (field[index] - '0');
+
+            } else if (size != 0) {
+                break;
+            }
+        }
+
+        return size;
+    }
+}
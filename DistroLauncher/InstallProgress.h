@@ -0,0 +1,27 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+// Reports the progress of the rootfs import while it is streamed into WSL:
+// once a second on the console, when stdout is one, and optionally as JSON
+// lines written to a file or a named pipe for provisioning tools.
+namespace InstallProgress
+{
+    // Also write every report as a line of JSON to path.
+    void EnableJson(std::wstring_view path);
+
+    // Start reporting the import of a rootfs of totalBytes bytes.
+    void Start(ULONGLONG totalBytes);
+
+    // Account for sourceBytes more bytes of the rootfs having been imported.
+    // If they were decoded to an uncompressed tarball, that data is given in
+    // tar so that the files it contains are counted. Only called by the
+    // thread that feeds the import.
+    void Advance(ULONGLONG sourceBytes, const BYTE* tar, SIZE_T tarSize);
+
+    // Stop reporting and print the final report of the import.
+    void Stop(HRESULT result);
+}
@@ -0,0 +1,113 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+#define BYTES_PER_MB (1024 * 1024)
+
+namespace {
+    HRESULT QueryDiskUsage(const std::wstring& diskPath, ULONGLONG* bytes);
+    HRESULT RunWsl(const std::wstring& arguments, DWORD* exitCode);
+}
+
+HRESULT Maintain::Compact()
+{
+    Timings::Scope timing("compact");
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    // WSL 1 distributions have no disk.
+    std::wstring keyName;
+    std::wstring diskPath;
+    HRESULT hr = StateCache::FindRegistration(&keyName, &diskPath);
+    if ((SUCCEEDED(hr)) && (diskPath.empty())) {
+        hr = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)) {
+        Helpers::PrintMessage(MSG_MAINTAIN_NO_DISK);
+    }
+
+    ULONGLONG before = 0;
+    if (SUCCEEDED(hr)) {
+        hr = QueryDiskUsage(diskPath, &before);
+    }
+
+    // A sparse disk shrinks by itself as blocks are trimmed, while any other
+    // one only grows. The mode can only be changed while the distribution is
+    // stopped, which is left to wsl.exe.
+    const std::wstring name = WslExe::QuoteArgument(DistributionInfo::Name);
+    DWORD exitCode = 0;
+    if ((SUCCEEDED(hr)) && ((GetFileAttributesW(diskPath.c_str()) & FILE_ATTRIBUTE_SPARSE_FILE) == 0)) {
+        Helpers::PrintMessage(MSG_MAINTAIN_SPARSE_ENABLING);
+        hr = RunWsl(L"--terminate " + name, &exitCode);
+        if (SUCCEEDED(hr)) {
+            hr = WslExe::Run(L"--manage " + name + L" --set-sparse true", &exitCode);
+        }
+
+        if ((SUCCEEDED(hr)) && (exitCode != 0)) {
+            Helpers::PrintMessage(MSG_MAINTAIN_SPARSE_FAILED, exitCode);
+        }
+    }
+
+    // The WSL API launches commands as the default user, who may not be
+    // allowed to trim, so wsl.exe runs fstrim as root.
+    if (SUCCEEDED(hr)) {
+        hr = RunWsl(L"--distribution " + name + L" --user root --exec fstrim --verbose /", &exitCode);
+    }
+
+    // The disk only reaches its final size once it is detached.
+    if (SUCCEEDED(hr)) {
+        hr = RunWsl(L"--terminate " + name, &exitCode);
+    }
+
+    ULONGLONG after = 0;
+    if (SUCCEEDED(hr)) {
+        hr = QueryDiskUsage(diskPath, &after);
+    }
+
+    if (SUCCEEDED(hr)) {
+        LARGE_INTEGER end;
+        QueryPerformanceCounter(&end);
+        const ULONG milliseconds = (ULONG)(((end.QuadPart - start.QuadPart) * 1000) / frequency.QuadPart);
+        const ULONGLONG reclaimed = (before > after) ? before - after : 0;
+        Helpers::PrintMessage(MSG_MAINTAIN_COMPACTED,
+                              (ULONG)(before / BYTES_PER_MB),
+                              (ULONG)(after / BYTES_PER_MB),
+                              (ULONG)(reclaimed / BYTES_PER_MB),
+                              milliseconds);
+    }
+
+    timing.SetResult(hr);
+    return hr;
+}
+
+namespace {
+    HRESULT QueryDiskUsage(const std::wstring& diskPath, ULONGLONG* bytes)
+    {
+        // The space the disk takes on the drive, rather than its size, which
+        // does not change with sparse files.
+        DWORD high;
+        const DWORD low = GetCompressedFileSizeW(diskPath.c_str(), &high);
+        if ((low == INVALID_FILE_SIZE) && (GetLastError() != NO_ERROR)) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        *bytes = ((ULONGLONG)high << 32) | low;
+        return S_OK;
+    }
+
+    HRESULT RunWsl(const std::wstring& arguments, DWORD* exitCode)
+    {
+        HRESULT hr = WslExe::Run(arguments, exitCode);
+        if ((SUCCEEDED(hr)) && (*exitCode != 0)) {
+            hr = E_FAIL;
+        }
+
+        return hr;
+    }
+}
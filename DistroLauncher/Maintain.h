@@ -0,0 +1,15 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+namespace Maintain
+{
+    // Give the space freed inside the distribution back to Windows: its disk
+    // is switched to sparse mode if it is not already, the free blocks of its
+    // file system are trimmed, and it is stopped so that the disk shrinks.
+    // The space reclaimed and the time taken are reported.
+    HRESULT Compact();
+}
@@ -0,0 +1,431 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+namespace {
+    const char Magic[] = "WSLBLK01";
+    const SIZE_T MagicSize = sizeof(Magic) - 1;
+    const SIZE_T HeaderSize = MagicSize + (2 * sizeof(UINT32));
+    const SIZE_T FrameHeaderSize = 2 * sizeof(UINT32);
+
+    // The same parameters as the packed rootfs of prepare-build.
+    const DWORD EncodeAlgorithm = COMPRESS_ALGORITHM_XPRESS_HUFF;
+    const UINT32 EncodeBlockSize = 4 * 1024 * 1024;
+
+    struct Frame
+    {
+        const BYTE* data;
+        UINT32 uncompressedSize;
+        UINT32 compressedSize;
+    };
+
+    // Blocks decoded by the workers, waiting to be written in order.
+    struct DecodeQueue
+    {
+        std::mutex lock;
+        std::condition_variable changed;
+        std::vector<std::vector<BYTE>> slots;
+        std::vector<bool> ready;
+        size_t nextToDecode = 0;
+        size_t nextToWrite = 0;
+        HRESULT result = S_OK;
+    };
+
+    // Frames encoded by the workers, waiting to be written in order. The
+    // workers take turns reading the next block of the input.
+    struct EncodeQueue
+    {
+        std::mutex lock;
+        std::condition_variable changed;
+        std::vector<std::vector<BYTE>> slots;
+        std::vector<bool> ready;
+        size_t nextToWrite = 0;
+        HRESULT result = S_OK;
+
+        std::mutex inputLock;
+        HANDLE input = nullptr;
+        size_t nextToRead = 0;
+        size_t frameCount = SIZE_MAX;
+        ULONGLONG bytesRead = 0;
+    };
+
+    UINT32 ReadUInt32(const BYTE* data);
+    void StoreUInt32(BYTE* data, UINT32 value);
+    HRESULT ParseFrames(const BYTE* image, SIZE_T imageSize, DWORD* algorithm, std::vector<Frame>* frames);
+    void DecodeWorker(DWORD algorithm, const std::vector<Frame>& frames, DecodeQueue* queue);
+    void EncodeWorker(EncodeQueue* queue);
+    HRESULT ReadBlock(HANDLE input, BYTE* block, DWORD* size);
+    HRESULT WriteAll(HANDLE output, const BYTE* data, SIZE_T size);
+}
+
+bool PackedRootfs::IsPackedImage(const std::wstring& path)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    char header[MagicSize];
+    DWORD size = 0;
+    const bool packed = ((ReadFile(file, header, (DWORD)sizeof(header), &size, nullptr)) &&
+                         (size == MagicSize) &&
+                         (memcmp(header, Magic, MagicSize) == 0));
+
+    CloseHandle(file);
+    return packed;
+}
+
+HRESULT PackedRootfs::Decode(const BYTE* image, SIZE_T imageSize, HANDLE output)
+{
+    DWORD algorithm;
+    std::vector<Frame> frames;
+    HRESULT hr = ParseFrames(image, imageSize, &algorithm, &frames);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // Keep a bounded window of blocks in flight so that memory usage only
+    // depends on the number of cores, not on the size of the image.
+    const size_t workerCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    DecodeQueue queue;
+    queue.slots.resize(workerCount * 2);
+    queue.ready.resize(queue.slots.size(), false);
+
+    std::vector<std::thread> workers;
+    for (size_t index = 0; index < workerCount; index += 1) {
+        workers.emplace_back(DecodeWorker, algorithm, std::cref(frames), &queue);
+    }
+
+    while (queue.nextToWrite < frames.size()) {
+        const size_t slot = queue.nextToWrite % queue.slots.size();
+        std::unique_lock<std::mutex> lock(queue.lock);
+        queue.changed.wait(lock, [&] { return queue.ready[slot] || FAILED(queue.result); });
+        if (FAILED(queue.result)) {
+            break;
+        }
+
+        // Write outside of the lock so that workers keep decoding meanwhile.
+        lock.unlock();
+        hr = WriteAll(output, queue.slots[slot].data(), queue.slots[slot].size());
+        if (SUCCEEDED(hr)) {
+            const Frame& frame = frames[queue.nextToWrite];
+            InstallProgress::Advance(FrameHeaderSize + frame.compressedSize, queue.slots[slot].data(), queue.slots[slot].size());
+        }
+
+        lock.lock();
+        if (FAILED(hr)) {
+            queue.result = hr;
+            queue.changed.notify_all();
+            break;
+        }
+
+        queue.ready[slot] = false;
+        queue.nextToWrite += 1;
+        queue.changed.notify_all();
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    return queue.result;
+}
+
+HRESULT PackedRootfs::Encode(HANDLE input, HANDLE output, const std::function<void(ULONGLONG, ULONGLONG)>& progress)
+{
+    BYTE header[HeaderSize];
+    memcpy(header, Magic, MagicSize);
+    StoreUInt32(header + MagicSize, EncodeAlgorithm);
+    StoreUInt32(header + MagicSize + sizeof(UINT32), EncodeBlockSize);
+    HRESULT hr = WriteAll(output, header, sizeof(header));
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // As when decoding, only a bounded window of blocks is in flight.
+    const size_t workerCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    EncodeQueue queue;
+    queue.input = input;
+    queue.slots.resize(workerCount * 2);
+    queue.ready.resize(queue.slots.size(), false);
+
+    std::vector<std::thread> workers;
+    for (size_t index = 0; index < workerCount; index += 1) {
+        workers.emplace_back(EncodeWorker, &queue);
+    }
+
+    ULONGLONG bytesWritten = sizeof(header);
+    while (true) {
+        const size_t slot = queue.nextToWrite % queue.slots.size();
+        std::unique_lock<std::mutex> lock(queue.lock);
+        queue.changed.wait(lock, [&] {
+            return queue.ready[slot] || FAILED(queue.result) || (queue.nextToWrite >= queue.frameCount);
+        });
+
+        if ((FAILED(queue.result)) || (queue.nextToWrite >= queue.frameCount)) {
+            break;
+        }
+
+        // Write outside of the lock so that workers keep encoding meanwhile.
+        lock.unlock();
+        hr = WriteAll(output, queue.slots[slot].data(), queue.slots[slot].size());
+        bytesWritten += queue.slots[slot].size();
+        lock.lock();
+        if (FAILED(hr)) {
+            queue.result = hr;
+            queue.changed.notify_all();
+            break;
+        }
+
+        queue.ready[slot] = false;
+        queue.nextToWrite += 1;
+        queue.changed.notify_all();
+        const ULONGLONG bytesRead = queue.bytesRead;
+        lock.unlock();
+        progress(bytesRead, bytesWritten);
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (FAILED(queue.result)) {
+        return queue.result;
+    }
+
+    const BYTE end[FrameHeaderSize] = {};
+    return WriteAll(output, end, sizeof(end));
+}
+
+namespace {
+    UINT32 ReadUInt32(const BYTE* data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | ((UINT32)data[3] << 24);
+    }
+
+    void StoreUInt32(BYTE* data, UINT32 value)
+    {
+        data[0] = (BYTE)value;
+        data[1] = (BYTE)(value >> 8);
+        data[2] = (BYTE)(value >> 16);
+        data[3] = (BYTE)(value >> 24);
+    }
+
+    HRESULT ParseFrames(const BYTE* image, SIZE_T imageSize, DWORD* algorithm, std::vector<Frame>* frames)
+    {
+        if ((imageSize < HeaderSize) || (memcmp(image, Magic, MagicSize) != 0)) {
+            return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+        }
+
+        *algorithm = ReadUInt32(image + MagicSize);
+        const UINT32 blockSize = ReadUInt32(image + MagicSize + sizeof(UINT32));
+        SIZE_T offset = HeaderSize;
+        while (true) {
+            if ((imageSize - offset) < FrameHeaderSize) {
+                return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+            }
+
+            Frame frame;
+            frame.uncompressedSize = ReadUInt32(image + offset);
+            frame.compressedSize = ReadUInt32(image + offset + sizeof(UINT32));
+            frame.data = image + offset + FrameHeaderSize;
+            offset += FrameHeaderSize;
+            if ((frame.uncompressedSize == 0) && (frame.compressedSize == 0)) {
+                return S_OK;
+            }
+
+            if ((frame.uncompressedSize > blockSize) ||
+                (frame.compressedSize > frame.uncompressedSize) ||
+                ((imageSize - offset) < frame.compressedSize)) {
+                return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            }
+
+            frames->push_back(frame);
+            offset += frame.compressedSize;
+        }
+    }
+
+    void DecodeWorker(DWORD algorithm, const std::vector<Frame>& frames, DecodeQueue* queue)
+    {
+        DECOMPRESSOR_HANDLE decompressor = nullptr;
+        HRESULT hr = S_OK;
+        if (!CreateDecompressor(algorithm | COMPRESS_RAW, nullptr, &decompressor)) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        std::vector<BYTE> buffer;
+        while (SUCCEEDED(hr)) {
+            // Claim the next block once its slot in the window is free.
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(queue->lock);
+                queue->changed.wait(lock, [&] {
+                    return FAILED(queue->result) ||
+                           (queue->nextToDecode >= frames.size()) ||
+                           (queue->nextToDecode < (queue->nextToWrite + queue->slots.size()));
+                });
+
+                if (FAILED(queue->result) || (queue->nextToDecode >= frames.size())) {
+                    break;
+                }
+
+                index = queue->nextToDecode;
+                queue->nextToDecode += 1;
+                buffer.swap(queue->slots[index % queue->slots.size()]);
+            }
+
+            const Frame& frame = frames[index];
+            buffer.resize(frame.uncompressedSize);
+            if (frame.compressedSize == frame.uncompressedSize) {
+                memcpy(buffer.data(), frame.data, frame.uncompressedSize);
+
+            } else {
+                SIZE_T decompressedSize = 0;
+                if (!::Decompress(decompressor, frame.data, frame.compressedSize, buffer.data(), buffer.size(), &decompressedSize)) {
+                    hr = HRESULT_FROM_WIN32(GetLastError());
+
+                } else if (decompressedSize != frame.uncompressedSize) {
+                    hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(queue->lock);
+            buffer.swap(queue->slots[index % queue->slots.size()]);
+            queue->ready[index % queue->slots.size()] = SUCCEEDED(hr);
+            queue->changed.notify_all();
+        }
+
+        if (FAILED(hr)) {
+            std::lock_guard<std::mutex> lock(queue->lock);
+            if (SUCCEEDED(queue->result)) {
+                queue->result = hr;
+            }
+
+            queue->changed.notify_all();
+        }
+
+        if (decompressor != nullptr) {
+            CloseDecompressor(decompressor);
+        }
+    }
+
+    void EncodeWorker(EncodeQueue* queue)
+    {
+        COMPRESSOR_HANDLE compressor = nullptr;
+        HRESULT hr = S_OK;
+        if (!CreateCompressor(EncodeAlgorithm | COMPRESS_RAW, nullptr, &compressor)) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        std::vector<BYTE> block(EncodeBlockSize);
+        std::vector<BYTE> frame;
+        while (SUCCEEDED(hr)) {
+            // Claim the next block of the input once its slot in the window is
+            // free, and read it while the other workers wait for their turn.
+            size_t index;
+            DWORD blockSize = 0;
+            {
+                std::lock_guard<std::mutex> inputLock(queue->inputLock);
+                {
+                    std::unique_lock<std::mutex> lock(queue->lock);
+                    queue->changed.wait(lock, [&] {
+                        return FAILED(queue->result) ||
+                               (queue->nextToRead >= queue->frameCount) ||
+                               (queue->nextToRead < (queue->nextToWrite + queue->slots.size()));
+                    });
+
+                    if (FAILED(queue->result) || (queue->nextToRead >= queue->frameCount)) {
+                        break;
+                    }
+                }
+
+                index = queue->nextToRead;
+                hr = ReadBlock(queue->input, block.data(), &blockSize);
+                std::lock_guard<std::mutex> lock(queue->lock);
+                if ((SUCCEEDED(hr)) && (blockSize == 0)) {
+                    queue->frameCount = index;
+                    queue->changed.notify_all();
+                    break;
+                }
+
+                queue->nextToRead += 1;
+                queue->bytesRead += blockSize;
+            }
+
+            if (FAILED(hr)) {
+                break;
+            }
+
+            // A block that does not shrink is stored as it is.
+            frame.resize(FrameHeaderSize + blockSize);
+            SIZE_T compressedSize = 0;
+            if ((!::Compress(compressor, block.data(), blockSize, frame.data() + FrameHeaderSize, blockSize, &compressedSize)) ||
+                (compressedSize >= blockSize)) {
+                memcpy(frame.data() + FrameHeaderSize, block.data(), blockSize);
+                compressedSize = blockSize;
+            }
+
+            frame.resize(FrameHeaderSize + compressedSize);
+            StoreUInt32(frame.data(), blockSize);
+            StoreUInt32(frame.data() + sizeof(UINT32), (UINT32)compressedSize);
+
+            std::lock_guard<std::mutex> lock(queue->lock);
+            frame.swap(queue->slots[index % queue->slots.size()]);
+            queue->ready[index % queue->slots.size()] = true;
+            queue->changed.notify_all();
+        }
+
+        if (FAILED(hr)) {
+            std::lock_guard<std::mutex> lock(queue->lock);
+            if (SUCCEEDED(queue->result)) {
+                queue->result = hr;
+            }
+
+            queue->changed.notify_all();
+        }
+
+        if (compressor != nullptr) {
+            CloseCompressor(compressor);
+        }
+    }
+
+    HRESULT ReadBlock(HANDLE input, BYTE* block, DWORD* size)
+    {
+        // Pipes return whatever was written to them, so reads are repeated
+        // until the block is full or the input ends.
+        *size = 0;
+        while (*size < EncodeBlockSize) {
+            DWORD read;
+            if (!ReadFile(input, block + *size, EncodeBlockSize - *size, &read, nullptr)) {
+                return (GetLastError() == ERROR_BROKEN_PIPE) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            if (read == 0) {
+                break;
+            }
+
+            *size += read;
+        }
+
+        return S_OK;
+    }
+
+    HRESULT WriteAll(HANDLE output, const BYTE* data, SIZE_T size)
+    {
+        while (size > 0) {
+            DWORD written;
+            const DWORD chunk = (DWORD)std::min<SIZE_T>(size, MAXDWORD);
+            if (!WriteFile(output, data, chunk, &written, nullptr)) {
+                return HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            data += written;
+            size -= written;
+        }
+
+        return S_OK;
+    }
+}
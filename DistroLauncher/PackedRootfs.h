@@ -0,0 +1,33 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+// A packed rootfs is a tarball cut into fixed-size blocks, each compressed
+// independently with the Windows Compression API so that they can be decoded
+// on every core at once and written back in order:
+//
+//     header: "WSLBLK01" | algorithm (u32) | block size (u32)
+//     frame:  uncompressed size (u32) | compressed size (u32) | data
+//     end:    a frame with both sizes set to 0
+//
+// A frame whose compressed size equals its uncompressed size is stored as-is.
+// All integers are little-endian.
+namespace PackedRootfs
+{
+    // The name of the packed rootfs in the package, next to install.tar.gz.
+    const std::wstring FileName = L"install.tar.blk";
+
+    // Whether the file at path starts like a packed image.
+    bool IsPackedImage(const std::wstring& path);
+
+    // Decode the packed image in memory and write the tarball, in order, to output.
+    HRESULT Decode(const BYTE* image, SIZE_T imageSize, HANDLE output);
+
+    // Read a tarball from input until it ends, compress its blocks on every
+    // core and write them, in order, to output as a packed image. progress is
+    // called after each block with the bytes read and written so far.
+    HRESULT Encode(HANDLE input, HANDLE output, const std::function<void(ULONGLONG, ULONGLONG)>& progress);
+}
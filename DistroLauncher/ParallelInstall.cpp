@@ -0,0 +1,171 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// The arguments given to each launcher. Installations run unattended, so no
+// user account is created.
+#define PARALLEL_INSTALL_ARGUMENTS L" install --root"
+
+namespace {
+    struct Installation
+    {
+        std::wstring launcher;
+        HRESULT result = S_OK;
+        DWORD exitCode = 1;
+        ULONGLONG durationMs = 0;
+        std::string output;
+    };
+
+    void Install(Installation* installation);
+}
+
+unsigned int ParallelInstall::DefaultJobs()
+{
+    // Each import keeps a core busy decompressing the rootfs and another one
+    // writing the disk of the distribution.
+    return std::max(1u, std::thread::hardware_concurrency() / 2);
+}
+
+HRESULT ParallelInstall::Run(const std::vector<std::wstring_view>& launchers, unsigned int jobs, DWORD* exitCode)
+{
+    Timings::Scope timing("install-many");
+    const ULONGLONG start = GetTickCount64();
+    std::vector<Installation> installations(launchers.size());
+    for (size_t index = 0; index < launchers.size(); index += 1) {
+        installations[index].launcher = launchers[index];
+    }
+
+    // Workers take the next installation until there are none left, and
+    // report each one as soon as it completes.
+    std::atomic<size_t> next{0};
+    std::mutex reportLock;
+    ULONG installed = 0;
+    const ULONG total = (ULONG)installations.size();
+    auto worker = [&] {
+        size_t index;
+        while ((index = next.fetch_add(1)) < installations.size()) {
+            Installation& installation = installations[index];
+            {
+                std::lock_guard<std::mutex> lock(reportLock);
+                Helpers::PrintMessage(MSG_INSTALL_MANY_STARTED, (ULONG)(index + 1), total, installation.launcher.c_str());
+            }
+
+            Install(&installation);
+            std::lock_guard<std::mutex> lock(reportLock);
+            if (FAILED(installation.result)) {
+                Helpers::PrintMessage(MSG_INSTALL_MANY_LAUNCH_FAILED, (ULONG)(index + 1), total, installation.launcher.c_str(), installation.result);
+                continue;
+            }
+
+            Helpers::PrintMessage(MSG_INSTALL_MANY_RESULT, (ULONG)(index + 1), total, installation.launcher.c_str(), installation.exitCode, (ULONG)installation.durationMs);
+            if (installation.exitCode == 0) {
+                installed += 1;
+
+            } else {
+                DWORD written;
+                WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), installation.output.data(), (DWORD)installation.output.size(), &written, nullptr);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int count = 0; count < std::min<size_t>(jobs, installations.size()); count += 1) {
+        workers.emplace_back(worker);
+    }
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    Helpers::PrintMessage(MSG_INSTALL_MANY_SUMMARY, installed, total, (ULONG)(GetTickCount64() - start));
+    *exitCode = (installed == total) ? 0 : 1;
+    return S_OK;
+}
+
+namespace {
+    void Install(Installation* installation)
+    {
+        const ULONGLONG start = GetTickCount64();
+        HANDLE outputRead;
+        HANDLE outputWrite;
+        SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
+        if (!CreatePipe(&outputRead, &outputWrite, &sa, 0)) {
+            installation->result = HRESULT_FROM_WIN32(GetLastError());
+            return;
+        }
+
+        SetHandleInformation(outputRead, HANDLE_FLAG_INHERIT, 0);
+        HANDLE input = CreateFileW(L"NUL", GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, nullptr);
+
+        // The launcher runs without a console of its own, so that it neither
+        // renames this window nor waits for input, and its output is kept to
+        // be printed if the installation fails. The name of an app execution
+        // alias is searched for on the path like any other executable.
+        //
+        // The other workers create their pipes at the same time, so the
+        // launcher only inherits its own handles: a write end held by another
+        // launcher would keep this pipe open until that one exits too.
+        std::wstring commandLine = WslExe::QuoteArgument(installation->launcher) + PARALLEL_INSTALL_ARGUMENTS;
+        std::vector<HANDLE> inherited{outputWrite};
+        if (input != INVALID_HANDLE_VALUE) {
+            inherited.push_back(input);
+        }
+
+        SIZE_T attributesSize = 0;
+        InitializeProcThreadAttributeList(nullptr, 1, 0, &attributesSize);
+        std::vector<BYTE> attributes(attributesSize);
+        STARTUPINFOEXW startupInfo{};
+        startupInfo.StartupInfo.cb = sizeof(startupInfo);
+        startupInfo.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+        startupInfo.StartupInfo.hStdInput = input;
+        startupInfo.StartupInfo.hStdOutput = outputWrite;
+        startupInfo.StartupInfo.hStdError = outputWrite;
+        startupInfo.lpAttributeList = (LPPROC_THREAD_ATTRIBUTE_LIST)attributes.data();
+        PROCESS_INFORMATION process;
+        BOOL created = InitializeProcThreadAttributeList(startupInfo.lpAttributeList, 1, 0, &attributesSize);
+        if (created) {
+            created = UpdateProcThreadAttribute(startupInfo.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited.data(), inherited.size() * sizeof(HANDLE), nullptr, nullptr);
+            if (created) {
+                created = CreateProcessW(nullptr, commandLine.data(), nullptr, nullptr, true, CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT, nullptr, nullptr, &startupInfo.StartupInfo, &process);
+            }
+
+            if (!created) {
+                installation->result = HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            DeleteProcThreadAttributeList(startupInfo.lpAttributeList);
+
+        } else {
+            installation->result = HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        // Close our copies of the ends given to the launcher so that the pipe
+        // reaches the end of file when it exits.
+        if (input != INVALID_HANDLE_VALUE) {
+            CloseHandle(input);
+        }
+
+        CloseHandle(outputWrite);
+        if (created) {
+            char buffer[4096];
+            DWORD read;
+            while ((ReadFile(outputRead, buffer, sizeof(buffer), &read, nullptr)) && (read > 0)) {
+                installation->output.append(buffer, read);
+            }
+
+            WaitForSingleObject(process.hProcess, INFINITE);
+            if (!GetExitCodeProcess(process.hProcess, &installation->exitCode)) {
+                installation->result = HRESULT_FROM_WIN32(GetLastError());
+            }
+
+            CloseHandle(process.hThread);
+            CloseHandle(process.hProcess);
+        }
+
+        CloseHandle(outputRead);
+        installation->durationMs = GetTickCount64() - start;
+    }
+}
@@ -0,0 +1,19 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+namespace ParallelInstall
+{
+    // The number of installations run at once when it is not given.
+    unsigned int DefaultJobs();
+
+    // Install the distribution of each launcher, given as the name or path
+    // of its executable, by running "install --root" on it, with at most jobs
+    // launchers at once. The result of each one is reported as it completes
+    // and the output of those that failed is printed. exitCode receives 0 if
+    // every installation succeeded, or 1.
+    HRESULT Run(const std::vector<std::wstring_view>& launchers, unsigned int jobs, DWORD* exitCode);
+}
@@ -0,0 +1,262 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// Sections of the provisioning file.
+#define SECTION_USER       "user"
+#define SECTION_WSL_CONF   "wsl.conf."
+#define SECTION_PACKAGES   "packages"
+#define SECTION_FIRST_BOOT "first-boot"
+
+#define WSL_CONF_PATH "/etc/wsl.conf"
+
+namespace {
+    struct User
+    {
+        std::string name;
+        std::string groups;
+        std::string passwordHash;
+        bool makeDefault = true;
+    };
+
+    HRESULT ReadFileContent(std::wstring_view path, std::string* data);
+    HRESULT InvalidLine(std::wstring_view path, size_t lineNumber, const std::string& line);
+    std::string Trim(const std::string& text);
+    std::wstring ToWide(std::string_view text);
+    std::string ToUtf8(std::wstring_view text);
+}
+
+HRESULT Provision::Load(std::wstring_view path, Plan* plan)
+{
+    std::string data;
+    HRESULT hr = ReadFileContent(path, &data);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    if (data.rfind("\xEF\xBB\xBF", 0) == 0) {
+        data.erase(0, 3);
+    }
+
+    // Declarations are gathered first, so that the steps always run in the
+    // same order whatever the order of the sections.
+    User user;
+    std::string wslConf;
+    std::vector<std::string> packages;
+    std::vector<std::string> firstBoot;
+    std::string section;
+    size_t userLine = 0;
+    size_t lineNumber = 0;
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = data.find('\n', start);
+        if (end == std::string::npos) {
+            end = data.size();
+        }
+
+        const std::string line = Trim(data.substr(start, end - start));
+        start = end + 1;
+        lineNumber += 1;
+        if ((line.empty()) || (line[0] == '#')) {
+            continue;
+        }
+
+        if ((line.front() == '[') && (line.back() == ']')) {
+            section = Trim(line.substr(1, line.size() - 2));
+            if ((section.rfind(SECTION_WSL_CONF, 0) == 0) && (section.size() > strlen(SECTION_WSL_CONF))) {
+                wslConf += "[" + section.substr(strlen(SECTION_WSL_CONF)) + "]\n";
+
+            } else if (section == SECTION_USER) {
+                userLine = lineNumber;
+
+            } else if ((section != SECTION_PACKAGES) && (section != SECTION_FIRST_BOOT)) {
+                return InvalidLine(path, lineNumber, line);
+            }
+
+            continue;
+        }
+
+        if (section == SECTION_PACKAGES) {
+            size_t position = 0;
+            while ((position = line.find_first_not_of(" \t", position)) != std::string::npos) {
+                const size_t next = line.find_first_of(" \t", position);
+                packages.push_back(line.substr(position, next - position));
+                position = next;
+            }
+
+            continue;
+        }
+
+        if (section == SECTION_FIRST_BOOT) {
+            firstBoot.push_back(line);
+            continue;
+        }
+
+        const size_t separator = line.find('=');
+        if ((section.empty()) || (separator == std::string::npos)) {
+            return InvalidLine(path, lineNumber, line);
+        }
+
+        const std::string key = Trim(line.substr(0, separator));
+        const std::string value = Trim(line.substr(separator + 1));
+        if (section != SECTION_USER) {
+            wslConf += key + " = " + value + "\n";
+
+        } else if (key == "name") {
+            user.name = value;
+
+        } else if (key == "groups") {
+            user.groups = value;
+
+        } else if (key == "password-hash") {
+            user.passwordHash = value;
+
+        } else if ((key == "default") && ((value == "true") || (value == "false"))) {
+            user.makeDefault = (value == "true");
+
+        } else {
+            return InvalidLine(path, lineNumber, line);
+        }
+    }
+
+    // A user section always names the account.
+    if ((userLine != 0) && (user.name.empty())) {
+        return InvalidLine(path, userLine, "[" SECTION_USER "]");
+    }
+
+    // The account is left alone if it already exists, so that a plan can run
+    // again. Without a password hash, it is created with a disabled password.
+    if (!user.name.empty()) {
+        const std::string name = Batch::QuoteShellArgument(user.name);
+        const std::string groups = user.groups.empty() ? ToUtf8(DistributionInfo::UserGroups) : user.groups;
+        std::string script = "{ id -u " + name + " >/dev/null 2>&1 || adduser --quiet --disabled-password --gecos '' " + name + "; } && ";
+        script += "usermod -aG " + Batch::QuoteShellArgument(groups) + " " + name;
+        if (!user.passwordHash.empty()) {
+            script += " && usermod -p " + Batch::QuoteShellArgument(user.passwordHash) + " " + name;
+        }
+
+        plan->commands.push_back({script, L"user " + ToWide(user.name), "provision-user"});
+        if (user.makeDefault) {
+            plan->defaultUser = ToWide(user.name);
+        }
+    }
+
+    if (!wslConf.empty()) {
+        const std::string script = "printf '%s' " + Batch::QuoteShellArgument(wslConf) + " > " WSL_CONF_PATH;
+        plan->commands.push_back({script, L"" WSL_CONF_PATH, "provision-wsl.conf"});
+        plan->restart = true;
+    }
+
+    if (!packages.empty()) {
+        std::string script = "export DEBIAN_FRONTEND=noninteractive; apt-get update -q && apt-get install -q -y --no-install-recommends";
+        std::wstring description = L"packages";
+        for (const auto& package : packages) {
+            script += " " + Batch::QuoteShellArgument(package);
+            description += L" " + ToWide(package);
+        }
+
+        plan->commands.push_back({script, description, "provision-packages"});
+    }
+
+    for (const auto& command : firstBoot) {
+        plan->commands.push_back({command, ToWide(command), "provision-first-boot"});
+    }
+
+    return S_OK;
+}
+
+HRESULT Provision::Apply(const Plan& plan)
+{
+    Timings::Scope timing("provision");
+    Helpers::PrintMessage(MSG_PROVISION_STARTED, (ULONG)plan.commands.size());
+    DWORD exitCode = 0;
+    HRESULT hr = S_OK;
+    if (!plan.commands.empty()) {
+        hr = Batch::RunCommands(plan.commands, false, &exitCode);
+        if ((SUCCEEDED(hr)) && (exitCode != 0)) {
+            Helpers::PrintMessage(MSG_PROVISION_FAILED, exitCode);
+            hr = E_FAIL;
+        }
+    }
+
+    // The distribution is still running, so looking the user up is quick.
+    if ((SUCCEEDED(hr)) && (!plan.defaultUser.empty())) {
+        const ULONG uid = DistributionInfo::QueryUid(plan.defaultUser);
+        hr = (uid == UID_INVALID) ? E_INVALIDARG : g_wslApi.WslConfigureDistribution(uid, WSL_DISTRIBUTION_FLAGS_DEFAULT);
+    }
+
+    // /etc/wsl.conf is only read when the distribution starts.
+    if ((SUCCEEDED(hr)) && (plan.restart)) {
+        hr = WslExe::Run(L"--terminate " + WslExe::QuoteArgument(DistributionInfo::Name), &exitCode);
+        if ((SUCCEEDED(hr)) && (exitCode != 0)) {
+            hr = E_FAIL;
+        }
+    }
+
+    timing.SetResult(hr);
+    return hr;
+}
+
+namespace {
+    HRESULT ReadFileContent(std::wstring_view path, std::string* data)
+    {
+        const std::wstring filePath(path);
+        HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        HRESULT hr = S_OK;
+        char buffer[4096];
+        DWORD bytesRead;
+        while (true) {
+            if (!ReadFile(file, buffer, sizeof(buffer), &bytesRead, nullptr)) {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+                break;
+            }
+
+            if (bytesRead == 0) {
+                break;
+            }
+
+            data->append(buffer, bytesRead);
+        }
+
+        CloseHandle(file);
+        return hr;
+    }
+
+    HRESULT InvalidLine(std::wstring_view path, size_t lineNumber, const std::string& line)
+    {
+        const std::wstring filePath(path);
+        Helpers::PrintMessage(MSG_PROVISION_INVALID_LINE, filePath.c_str(), (ULONG)lineNumber, ToWide(line).c_str());
+        return E_INVALIDARG;
+    }
+
+    std::string Trim(const std::string& text)
+    {
+        const size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos) {
+            return "";
+        }
+
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    std::wstring ToWide(std::string_view text)
+    {
+        std::wstring wide(text.size(), L'\0');
+        wide.resize(MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), wide.data(), (int)wide.size()));
+        return wide;
+    }
+
+    std::string ToUtf8(std::wstring_view text)
+    {
+        std::string narrow(WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), nullptr, 0, nullptr, nullptr), '\0');
+        WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), narrow.data(), (int)narrow.size(), nullptr, nullptr);
+        return narrow;
+    }
+}
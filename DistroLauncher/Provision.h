@@ -0,0 +1,45 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+// Unattended provisioning from a declarative file, applied right after the
+// distribution is registered, in a single shell session:
+//
+//     [user]
+//     name = <user name>
+//     groups = <groups, separated by commas>
+//     password-hash = <crypt(3) hash>
+//     default = true|false
+//
+//     [wsl.conf.<section>]
+//     <key> = <value>
+//
+//     [packages]
+//     <package> ...
+//
+//     [first-boot]
+//     <command line>
+//
+// The user account is created first, then /etc/wsl.conf is written, the
+// packages are installed and the first boot commands run, in order, as root.
+namespace Provision
+{
+    // The execution plan compiled from a provisioning file.
+    struct Plan
+    {
+        std::vector<Batch::Command> commands;
+        // The user made the default one, if any.
+        std::wstring defaultUser;
+        // Whether the distribution must restart for wsl.conf to apply.
+        bool restart = false;
+    };
+
+    // Read and compile the provisioning file at path.
+    HRESULT Load(std::wstring_view path, Plan* plan);
+
+    // Apply the plan to the distribution, which was just registered.
+    HRESULT Apply(const Plan& plan);
+}
@@ -0,0 +1,470 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+#define ROOTFS_TARBALL L"install.tar.gz"
+#define ROOTFS_VHDX    L"install.vhdx"
+#define ROOTFS_LAYERS  L"install.layers"
+
+// Size of the pipe buffer between the decoder and the WSL import.
+#define ROOTFS_PIPE_BUFFER_SIZE (1024 * 1024)
+
+// Size of the reads from install.tar.gz when it is streamed into the import.
+// Reads bypass the file cache, so it must be a multiple of the sector size.
+#define ROOTFS_READ_SIZE (4 * 1024 * 1024)
+
+// Each source reports through started whether WSL got as far as reading it.
+// Once it has, its result stands: importing another source would only repeat
+// the failure, or register over a half-imported distribution.
+namespace {
+    HRESULT RegisterFromVhdx(const std::wstring& vhdxPath, bool* started);
+    bool CanImportVhdx();
+    HRESULT RegisterFromPackedImage(const std::wstring& imagePath, bool* started);
+    HRESULT RegisterFromLayers(const std::wstring& directory, const std::wstring& manifestPath, bool* started);
+    HRESULT RegisterFromTarball(const std::wstring& tarballPath, bool* started);
+    HANDLE OpenRootfsFile(const std::wstring& path);
+    HRESULT CopyToStream(HANDLE input, HANDLE output);
+    HRESULT RegisterFromStream(ULONGLONG totalBytes, const std::function<HRESULT(HANDLE)>& producer, bool* started);
+}
+
+HRESULT RootfsImport::RegisterDistribution(std::wstring_view rootfsPath)
+{
+    bool started;
+    if (!rootfsPath.empty()) {
+        const std::wstring path(rootfsPath);
+        return PackedRootfs::IsPackedImage(path) ? RegisterFromPackedImage(path, &started) : RegisterFromTarball(path, &started);
+    }
+
+    // Prefer the prebuilt disk, which only needs to be copied.
+    const std::wstring moduleDirectory = Helpers::GetModuleDirectory();
+    const std::wstring vhdx = moduleDirectory + L"\\" ROOTFS_VHDX;
+    if (GetFileAttributesW(vhdx.c_str()) != INVALID_FILE_ATTRIBUTES) {
+        HRESULT hr = RegisterFromVhdx(vhdx, &started);
+        if ((SUCCEEDED(hr)) || (started)) {
+            return hr;
+        }
+
+        Helpers::PrintMessage(MSG_VHDX_IMPORT_FALLBACK, hr);
+    }
+
+    // Then the packed rootfs, which is decoded on every core and streamed
+    // straight into the import.
+    const std::wstring packedImage = moduleDirectory + L"\\" + PackedRootfs::FileName;
+    if (GetFileAttributesW(packedImage.c_str()) != INVALID_FILE_ATTRIBUTES) {
+        HRESULT hr = RegisterFromPackedImage(packedImage, &started);
+        if ((SUCCEEDED(hr)) || (started) || (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS))) {
+            return hr;
+        }
+
+        Helpers::PrintMessage(MSG_PACKED_ROOTFS_FALLBACK, hr);
+    }
+
+    // Then the layers, which are streamed one after the other as a single
+    // tarball. Packages shipping them usually leave install.tar.gz out.
+    const std::wstring tarball = moduleDirectory + L"\\" ROOTFS_TARBALL;
+    const std::wstring layers = moduleDirectory + L"\\" ROOTFS_LAYERS;
+    if (GetFileAttributesW(layers.c_str()) != INVALID_FILE_ATTRIBUTES) {
+        HRESULT hr = RegisterFromLayers(moduleDirectory, layers, &started);
+        if ((SUCCEEDED(hr)) || (started) || (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS)) ||
+            (GetFileAttributesW(tarball.c_str()) == INVALID_FILE_ATTRIBUTES)) {
+            return hr;
+        }
+
+        Helpers::PrintMessage(MSG_LAYERS_FALLBACK, hr);
+    }
+
+    // The tarball is streamed too, so that the progress of the import can be
+    // reported, and is only handed over to WSL as a file if the stream could
+    // not be set up.
+    HRESULT hr = RegisterFromTarball(tarball, &started);
+    if ((SUCCEEDED(hr)) || (started) || (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS))) {
+        return hr;
+    }
+
+    return g_wslApi.WslRegisterDistribution(ROOTFS_TARBALL);
+}
+
+namespace {
+    HRESULT RegisterFromVhdx(const std::wstring& vhdxPath, bool* started)
+    {
+        // The WSL API only imports tarballs, so the disk is imported by
+        // wsl.exe, which copies it next to where WslRegisterDistribution
+        // would have created it. The package folder is read-only, so the disk
+        // cannot be used in place.
+        *started = false;
+        if (!CanImportVhdx()) {
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        }
+
+        Timings::Scope timing("import-vhdx");
+        const std::wstring localState = Helpers::GetLocalStateDirectory();
+        if (localState.empty()) {
+            timing.SetResult(HRESULT_FROM_WIN32(APPMODEL_ERROR_NO_PACKAGE));
+            return HRESULT_FROM_WIN32(APPMODEL_ERROR_NO_PACKAGE);
+        }
+
+        std::wstring arguments = L"--import ";
+        arguments += WslExe::QuoteArgument(DistributionInfo::Name) + L" ";
+        arguments += WslExe::QuoteArgument(localState) + L" ";
+        arguments += WslExe::QuoteArgument(vhdxPath) + L" --vhd";
+        DWORD exitCode;
+        HRESULT hr = WslExe::Run(arguments, &exitCode);
+        if (SUCCEEDED(hr)) {
+            *started = true;
+            if (exitCode != 0) {
+                hr = E_FAIL;
+            }
+        }
+
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    bool CanImportVhdx()
+    {
+        // The wsl.exe built into Windows can neither import a disk nor print
+        // its version, while every release from the Store that can print its
+        // version also imports disks.
+        SECURITY_ATTRIBUTES attributes{sizeof(attributes), nullptr, TRUE};
+        HANDLE nul = CreateFileW(L"NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &attributes, OPEN_EXISTING, 0, nullptr);
+        if (nul == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        HANDLE process;
+        DWORD exitCode = 1;
+        if (SUCCEEDED(WslExe::Launch(L"--version", nul, &process))) {
+            WaitForSingleObject(process, INFINITE);
+            GetExitCodeProcess(process, &exitCode);
+            CloseHandle(process);
+        }
+
+        CloseHandle(nul);
+        return (exitCode == 0);
+    }
+
+    HRESULT RegisterFromPackedImage(const std::wstring& imagePath, bool* started)
+    {
+        *started = false;
+        HANDLE file = CreateFileW(imagePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        // Map the image so that the decoders read it straight from the page cache.
+        HRESULT hr = S_OK;
+        LARGE_INTEGER size;
+        HANDLE mapping = nullptr;
+        const BYTE* image = nullptr;
+        if (!GetFileSizeEx(file, &size)) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+
+        } else if ((mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) == nullptr) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+
+        } else if ((image = (const BYTE*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) == nullptr) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        if (SUCCEEDED(hr)) {
+            hr = RegisterFromStream(size.QuadPart, [&](HANDLE output) {
+                return PackedRootfs::Decode(image, (SIZE_T)size.QuadPart, output);
+            }, started);
+        }
+
+        if (image != nullptr) {
+            UnmapViewOfFile(image);
+        }
+
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+
+        CloseHandle(file);
+        return hr;
+    }
+
+    HRESULT RegisterFromLayers(const std::wstring& directory, const std::wstring& manifestPath, bool* started)
+    {
+        *started = false;
+        // The manifest lists the layer files, base first, one per line.
+        HANDLE manifest = CreateFileW(manifestPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (manifest == INVALID_HANDLE_VALUE) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        HRESULT hr = S_OK;
+        std::string content;
+        char buffer[4096];
+        DWORD read;
+        while (true) {
+            if (!ReadFile(manifest, buffer, sizeof(buffer), &read, nullptr)) {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+                break;
+            }
+
+            if (read == 0) {
+                break;
+            }
+
+            content.append(buffer, read);
+        }
+
+        CloseHandle(manifest);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // Every layer is opened first, so that the size of the whole rootfs is
+        // known before the import starts.
+        std::vector<HANDLE> files;
+        ULONGLONG totalBytes = 0;
+        size_t start = 0;
+        while ((SUCCEEDED(hr)) && (start < content.size())) {
+            size_t end = content.find('\n', start);
+            if (end == std::string::npos) {
+                end = content.size();
+            }
+
+            std::string name = content.substr(start, end - start);
+            start = end + 1;
+            if ((!name.empty()) && (name.back() == '\r')) {
+                name.pop_back();
+            }
+
+            // Layers are named by their checksum, so anything else in the
+            // manifest is not a layer.
+            if ((name.empty()) || (name.find_first_of("\\/:") != std::string::npos)) {
+                continue;
+            }
+
+            HANDLE file = OpenRootfsFile(directory + L"\\" + std::wstring(name.begin(), name.end()));
+            LARGE_INTEGER size;
+            if (file == INVALID_HANDLE_VALUE) {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+
+            } else if (!GetFileSizeEx(file, &size)) {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+                CloseHandle(file);
+
+            } else {
+                files.push_back(file);
+                totalBytes += size.QuadPart;
+            }
+        }
+
+        if ((SUCCEEDED(hr)) && (files.empty())) {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        // Each layer is a gzip member, which WSL decompresses as part of the
+        // same stream.
+        if (SUCCEEDED(hr)) {
+            Timings::Scope timing("import-layers");
+            hr = RegisterFromStream(totalBytes, [&](HANDLE output) {
+                for (HANDLE file : files) {
+                    HRESULT copied = CopyToStream(file, output);
+                    if (FAILED(copied)) {
+                        return copied;
+                    }
+                }
+
+                return S_OK;
+            }, started);
+
+            timing.SetResult(hr);
+        }
+
+        for (HANDLE file : files) {
+            CloseHandle(file);
+        }
+
+        return hr;
+    }
+
+    HRESULT RegisterFromTarball(const std::wstring& tarballPath, bool* started)
+    {
+        *started = false;
+        HANDLE file = OpenRootfsFile(tarballPath);
+        if (file == INVALID_HANDLE_VALUE) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+            CloseHandle(file);
+            return hr;
+        }
+
+        // WSL decompresses the tarball itself, so it is copied as it is.
+        HRESULT hr = RegisterFromStream(size.QuadPart, [&](HANDLE output) {
+            return CopyToStream(file, output);
+        }, started);
+
+        CloseHandle(file);
+        return hr;
+    }
+
+    HANDLE OpenRootfsFile(const std::wstring& path)
+    {
+        // The rootfs is read once and WSL keeps its own copy of it, so its
+        // pages would only evict more useful ones from the file cache.
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, nullptr);
+        if ((file == INVALID_HANDLE_VALUE) && (GetLastError() == ERROR_INVALID_PARAMETER)) {
+            file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_OVERLAPPED, nullptr);
+        }
+
+        return file;
+    }
+
+    HRESULT CopyToStream(HANDLE input, HANDLE output)
+    {
+        // Two page aligned buffers, so that the next read from the package is
+        // in flight while the previous one is written into the import.
+        BYTE* buffers = (BYTE*)VirtualAlloc(nullptr, 2 * ROOTFS_READ_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (buffers == nullptr) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (overlapped.hEvent == nullptr) {
+            HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+            VirtualFree(buffers, 0, MEM_RELEASE);
+            return hr;
+        }
+
+        // Reads are issued at the offset of the file following the previous
+        // one. Only a full read may be followed by more data.
+        ULONGLONG offset = 0;
+        auto startRead = [&](BYTE* buffer) {
+            overlapped.Offset = (DWORD)offset;
+            overlapped.OffsetHigh = (DWORD)(offset >> 32);
+            return (ReadFile(input, buffer, ROOTFS_READ_SIZE, nullptr, &overlapped)) || (GetLastError() == ERROR_IO_PENDING);
+        };
+
+        HRESULT hr = S_OK;
+        BYTE* current = buffers;
+        bool pending = startRead(current);
+        if ((!pending) && (GetLastError() != ERROR_HANDLE_EOF)) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        while (pending) {
+            DWORD read = 0;
+            pending = false;
+            if (!GetOverlappedResult(input, &overlapped, &read, TRUE)) {
+                if (GetLastError() != ERROR_HANDLE_EOF) {
+                    hr = HRESULT_FROM_WIN32(GetLastError());
+                }
+
+                break;
+            }
+
+            offset += read;
+            BYTE* data = current;
+            current = (current == buffers) ? buffers + ROOTFS_READ_SIZE : buffers;
+            if (read == ROOTFS_READ_SIZE) {
+                pending = startRead(current);
+                if ((!pending) && (GetLastError() != ERROR_HANDLE_EOF)) {
+                    hr = HRESULT_FROM_WIN32(GetLastError());
+                    break;
+                }
+            }
+
+            for (DWORD written = 0; written < read;) {
+                DWORD chunk;
+                if (!WriteFile(output, data + written, read - written, &chunk, nullptr)) {
+                    hr = HRESULT_FROM_WIN32(GetLastError());
+                    break;
+                }
+
+                written += chunk;
+            }
+
+            if (FAILED(hr)) {
+                break;
+            }
+
+            InstallProgress::Advance(read, nullptr, 0);
+        }
+
+        // The buffers are only released once no read may still fill them.
+        if (pending) {
+            DWORD read;
+            CancelIo(input);
+            GetOverlappedResult(input, &overlapped, &read, TRUE);
+        }
+
+        CloseHandle(overlapped.hEvent);
+        VirtualFree(buffers, 0, MEM_RELEASE);
+        return hr;
+    }
+
+    HRESULT RegisterFromStream(ULONGLONG totalBytes, const std::function<HRESULT(HANDLE)>& producer, bool* started)
+    {
+        // WslRegisterDistribution opens the path it is given like any other
+        // file, so a named pipe lets the tarball be imported while it is being
+        // produced, without staging an uncompressed copy on disk.
+        const std::wstring pipeName = L"\\\\.\\pipe\\" + DistributionInfo::Name + L"-rootfs-" + std::to_wstring(GetCurrentProcessId());
+        HANDLE pipe = CreateNamedPipeW(pipeName.c_str(),
+                                       PIPE_ACCESS_OUTBOUND | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                       PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                       1,
+                                       ROOTFS_PIPE_BUFFER_SIZE,
+                                       0,
+                                       0,
+                                       nullptr);
+
+        if (pipe == INVALID_HANDLE_VALUE) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        // The import only sees the end of the tarball once the pipe is
+        // disconnected, whether the producer finished or not.
+        InstallProgress::Start(totalBytes);
+        HRESULT producerHr = S_OK;
+        std::thread writer([&] {
+            if ((ConnectNamedPipe(pipe, nullptr)) || (GetLastError() == ERROR_PIPE_CONNECTED)) {
+                producerHr = producer(pipe);
+                if (SUCCEEDED(producerHr)) {
+                    FlushFileBuffers(pipe);
+                }
+
+                DisconnectNamedPipe(pipe);
+            }
+        });
+
+        HRESULT hr = g_wslApi.WslRegisterDistribution(pipeName.c_str());
+
+        // If the import never opened the pipe, connect to it ourselves so that
+        // the writer wakes up; any further write then fails on a closed pipe.
+        // The pipe has a single instance, so this only succeeds if the import
+        // never read from it, and the pipe, not the rootfs, may be the reason.
+        HANDLE client = CreateFileW(pipeName.c_str(), GENERIC_READ, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (client != INVALID_HANDLE_VALUE) {
+            CloseHandle(client);
+
+        } else {
+            *started = true;
+        }
+
+        writer.join();
+        CloseHandle(pipe);
+
+        // A tarball cut short can still be a valid archive, so the import may
+        // have registered part of the rootfs: it must not be kept.
+        if ((SUCCEEDED(hr)) && (FAILED(producerHr))) {
+            DWORD exitCode;
+            WslExe::Run(L"--unregister " + WslExe::QuoteArgument(DistributionInfo::Name), &exitCode);
+            hr = producerHr;
+        }
+
+        InstallProgress::Stop(hr);
+        return hr;
+    }
+}
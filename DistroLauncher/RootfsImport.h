@@ -0,0 +1,18 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+namespace RootfsImport
+{
+    // Register the distribution from the fastest rootfs format shipped in the
+    // package: a prebuilt install.vhdx, then a packed rootfs, then the layers
+    // listed in install.layers, and finally install.tar.gz when no other
+    // format is present or WSL could not start reading it. A source WSL did
+    // start to import is not retried from another. If rootfsPath is not
+    // empty, the packed rootfs or tarball it names, such as a backup made by
+    // export, is imported instead.
+    HRESULT RegisterDistribution(std::wstring_view rootfsPath);
+}
@@ -0,0 +1,315 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+#define STATE_CACHE_FILE L"launcher.state"
+
+// Changes whenever the layout of the cache does, so that older files are
+// ignored rather than misread.
+#define STATE_CACHE_MAGIC 0x32534c57
+
+#define STATE_CACHE_KEY_SIZE         64
+#define STATE_CACHE_ENVIRONMENT_SIZE 4096
+
+// How long to wait for another launcher using the cache before doing without.
+#define STATE_CACHE_LOCK_TIMEOUT 100
+
+// Where WSL records the registered distributions, one subkey each.
+#define LXSS_KEY L"Software\\Microsoft\\Windows\\CurrentVersion\\Lxss"
+#define LXSS_DEFAULT_VHD L"ext4.vhdx"
+
+namespace {
+    // The content of the cache file.
+    struct State
+    {
+        ULONG magic;
+
+        // The registry key of the distribution, which is created anew when it
+        // is registered again, and the time WSL last wrote to it.
+        WCHAR keyName[STATE_CACHE_KEY_SIZE];
+        FILETIME keyWriteTime;
+
+        // The configuration as of keyWriteTime.
+        BOOL hasConfiguration;
+        ULONG distributionVersion;
+        ULONG defaultUid;
+        ULONG flags;
+        ULONG environmentSize;
+        CHAR environment[STATE_CACHE_ENVIRONMENT_SIZE];
+    };
+
+    // The mapped cache, shared by the launchers of the distribution through a
+    // named mutex.
+    class MappedState
+    {
+      public:
+        MappedState();
+        ~MappedState();
+
+        // Copy the cache into state, if it is valid.
+        bool Read(State* state);
+
+        // Update the cache, starting from a copy of its content.
+        void Write(const std::function<void(State*)>& update);
+
+      private:
+        bool Lock();
+
+        HANDLE _lock = nullptr;
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = nullptr;
+        State* _state = nullptr;
+    };
+
+    MappedState& GetMappedState();
+    HRESULT QueryKeyWriteTime(PCWSTR keyName, FILETIME* writeTime);
+}
+
+HRESULT StateCache::FindRegistration(std::wstring* keyName, std::wstring* diskPath)
+{
+    HKEY lxss;
+    LSTATUS status = RegOpenKeyExW(HKEY_CURRENT_USER, LXSS_KEY, 0, KEY_READ, &lxss);
+    if (status != ERROR_SUCCESS) {
+        return HRESULT_FROM_WIN32(status);
+    }
+
+    status = ERROR_FILE_NOT_FOUND;
+    WCHAR subkey[STATE_CACHE_KEY_SIZE];
+    for (DWORD index = 0; (status == ERROR_FILE_NOT_FOUND); index += 1) {
+        DWORD subkeyLength = ARRAYSIZE(subkey);
+        if (RegEnumKeyExW(lxss, index, subkey, &subkeyLength, nullptr, nullptr, nullptr, nullptr) != ERROR_SUCCESS) {
+            break;
+        }
+
+        WCHAR value[MAX_PATH];
+        DWORD size = sizeof(value);
+        if ((RegGetValueW(lxss, subkey, L"DistributionName", RRF_RT_REG_SZ, nullptr, value, &size) != ERROR_SUCCESS) ||
+            (_wcsicmp(value, DistributionInfo::Name.c_str()) != 0)) {
+            continue;
+        }
+
+        *keyName = subkey;
+        diskPath->clear();
+        status = ERROR_SUCCESS;
+        size = sizeof(value);
+        if (RegGetValueW(lxss, subkey, L"BasePath", RRF_RT_REG_SZ, nullptr, value, &size) == ERROR_SUCCESS) {
+            std::wstring path = std::wstring(value) + L"\\";
+            size = sizeof(value);
+            path += (RegGetValueW(lxss, subkey, L"VhdFileName", RRF_RT_REG_SZ, nullptr, value, &size) == ERROR_SUCCESS) ? value : LXSS_DEFAULT_VHD;
+            if (GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES) {
+                *diskPath = path;
+            }
+        }
+    }
+
+    RegCloseKey(lxss);
+    return HRESULT_FROM_WIN32(status);
+}
+
+bool StateCache::IsRegistered()
+{
+    // The key only exists while the distribution is registered.
+    State state;
+    FILETIME writeTime;
+    return ((GetMappedState().Read(&state)) &&
+            (state.keyName[0] != L'\0') &&
+            (SUCCEEDED(QueryKeyWriteTime(state.keyName, &writeTime))));
+}
+
+void StateCache::StoreRegistration()
+{
+    std::wstring keyName;
+    std::wstring diskPath;
+    if ((FAILED(FindRegistration(&keyName, &diskPath))) ||
+        (keyName.size() >= STATE_CACHE_KEY_SIZE)) {
+        return;
+    }
+
+    FILETIME writeTime;
+    if (FAILED(QueryKeyWriteTime(keyName.c_str(), &writeTime))) {
+        return;
+    }
+
+    // Anything recorded for an earlier registration no longer applies.
+    GetMappedState().Write([&](State* state) {
+        if (wcscmp(state->keyName, keyName.c_str()) != 0) {
+            ZeroMemory(state, sizeof(*state));
+            state->magic = STATE_CACHE_MAGIC;
+            wcscpy_s(state->keyName, keyName.c_str());
+            state->keyWriteTime = writeTime;
+        }
+    });
+}
+
+bool StateCache::GetConfiguration(ULONG* distributionVersion, ULONG* defaultUID, WSL_DISTRIBUTION_FLAGS* wslDistributionFlags, std::vector<std::string>* environment, FILETIME* keyWriteTime)
+{
+    // The time is read before WSL is asked, so that a change made in between
+    // leaves the configuration stale in the cache rather than current.
+    State state;
+    if ((!GetMappedState().Read(&state)) ||
+        (state.keyName[0] == L'\0') ||
+        (FAILED(QueryKeyWriteTime(state.keyName, keyWriteTime)))) {
+        *keyWriteTime = {};
+        return false;
+    }
+
+    if ((!state.hasConfiguration) || (CompareFileTime(keyWriteTime, &state.keyWriteTime) != 0)) {
+        return false;
+    }
+
+    *distributionVersion = state.distributionVersion;
+    *defaultUID = state.defaultUid;
+    *wslDistributionFlags = (WSL_DISTRIBUTION_FLAGS)state.flags;
+    environment->clear();
+    for (ULONG offset = 0; offset < state.environmentSize;) {
+        environment->emplace_back(state.environment + offset);
+        offset += (ULONG)environment->back().size() + 1;
+    }
+
+    return true;
+}
+
+void StateCache::StoreConfiguration(const FILETIME& keyWriteTime, ULONG distributionVersion, ULONG defaultUID, WSL_DISTRIBUTION_FLAGS wslDistributionFlags, const std::vector<std::string>& environment)
+{
+    ULONG environmentSize = 0;
+    for (const auto& variable : environment) {
+        environmentSize += (ULONG)variable.size() + 1;
+    }
+
+    if ((environmentSize > STATE_CACHE_ENVIRONMENT_SIZE) ||
+        ((keyWriteTime.dwLowDateTime == 0) && (keyWriteTime.dwHighDateTime == 0))) {
+        return;
+    }
+
+    // The configuration lives in the key, so it is current as of the time
+    // the key was last written before it was read.
+    GetMappedState().Write([&](State* state) {
+        if (state->keyName[0] == L'\0') {
+            return;
+        }
+
+        state->keyWriteTime = keyWriteTime;
+        state->hasConfiguration = true;
+        state->distributionVersion = distributionVersion;
+        state->defaultUid = defaultUID;
+        state->flags = (ULONG)wslDistributionFlags;
+        state->environmentSize = 0;
+        for (const auto& variable : environment) {
+            CopyMemory(state->environment + state->environmentSize, variable.c_str(), variable.size() + 1);
+            state->environmentSize += (ULONG)variable.size() + 1;
+        }
+    });
+}
+
+namespace {
+    MappedState::MappedState()
+    {
+        const std::wstring localState = Helpers::GetLocalStateDirectory();
+        if (localState.empty()) {
+            return;
+        }
+
+        const std::wstring lockName = L"Local\\" + DistributionInfo::Name + L"-state";
+        _lock = CreateMutexW(nullptr, false, lockName.c_str());
+        if (_lock == nullptr) {
+            return;
+        }
+
+        const std::wstring path = localState + L"\\" STATE_CACHE_FILE;
+        _file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        // A new file is extended to the size of the cache, and reads as zeros,
+        // an invalid cache, until it is first written.
+        _mapping = CreateFileMappingW(_file, nullptr, PAGE_READWRITE, 0, sizeof(State), nullptr);
+        if (_mapping != nullptr) {
+            _state = (State*)MapViewOfFile(_mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(State));
+        }
+    }
+
+    MappedState::~MappedState()
+    {
+        if (_state != nullptr) {
+            UnmapViewOfFile(_state);
+        }
+
+        if (_mapping != nullptr) {
+            CloseHandle(_mapping);
+        }
+
+        if (_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(_file);
+        }
+
+        if (_lock != nullptr) {
+            CloseHandle(_lock);
+        }
+    }
+
+    bool MappedState::Read(State* state)
+    {
+        if (!Lock()) {
+            return false;
+        }
+
+        CopyMemory(state, _state, sizeof(*state));
+        ReleaseMutex(_lock);
+        state->keyName[STATE_CACHE_KEY_SIZE - 1] = L'\0';
+        return ((state->magic == STATE_CACHE_MAGIC) && (state->environmentSize <= STATE_CACHE_ENVIRONMENT_SIZE));
+    }
+
+    void MappedState::Write(const std::function<void(State*)>& update)
+    {
+        if (!Lock()) {
+            return;
+        }
+
+        State state;
+        CopyMemory(&state, _state, sizeof(state));
+        if (state.magic != STATE_CACHE_MAGIC) {
+            ZeroMemory(&state, sizeof(state));
+            state.magic = STATE_CACHE_MAGIC;
+        }
+
+        update(&state);
+        CopyMemory(_state, &state, sizeof(state));
+        ReleaseMutex(_lock);
+    }
+
+    bool MappedState::Lock()
+    {
+        // A launcher that exited while holding the lock did so between two
+        // copies of the whole state, so the cache is still consistent.
+        if (_state == nullptr) {
+            return false;
+        }
+
+        const DWORD wait = WaitForSingleObject(_lock, STATE_CACHE_LOCK_TIMEOUT);
+        return ((wait == WAIT_OBJECT_0) || (wait == WAIT_ABANDONED));
+    }
+
+    MappedState& GetMappedState()
+    {
+        static MappedState state;
+        return state;
+    }
+
+    HRESULT QueryKeyWriteTime(PCWSTR keyName, FILETIME* writeTime)
+    {
+        const std::wstring path = std::wstring(LXSS_KEY L"\\") + keyName;
+        HKEY key;
+        LSTATUS status = RegOpenKeyExW(HKEY_CURRENT_USER, path.c_str(), 0, KEY_QUERY_VALUE, &key);
+        if (status != ERROR_SUCCESS) {
+            return HRESULT_FROM_WIN32(status);
+        }
+
+        status = RegQueryInfoKeyW(key, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, writeTime);
+        RegCloseKey(key);
+        return HRESULT_FROM_WIN32(status);
+    }
+}
@@ -0,0 +1,44 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+// What the WSL API and the distribution last reported, kept in a small file
+// mapped from the LocalState folder of the package so that steady-state
+// launches do not ask again. Every entry is checked against the registry key
+// WSL keeps for the distribution, so that changes made by wsl.exe are
+// noticed. Nothing read from inside the distribution is kept: its disk stays
+// open while it runs, so there is no cheap way to tell it changed. The cache
+// is disabled when the launcher is not packaged.
+namespace StateCache
+{
+    // Find the registry key of the distribution under the Lxss key of WSL and
+    // the path of its disk, which is left empty for WSL 1 distributions.
+    HRESULT FindRegistration(std::wstring* keyName, std::wstring* diskPath);
+
+    // Whether the distribution is known to be registered. If not, it may
+    // still be, and WSL has to be asked.
+    bool IsRegistered();
+
+    // Record that the distribution is registered.
+    void StoreRegistration();
+
+    // Get the configuration last read, if WSL did not change it since. If
+    // not, keyWriteTime receives the time WSL last changed it, to be given to
+    // StoreConfiguration along with the configuration then read from WSL.
+    bool GetConfiguration(ULONG* distributionVersion,
+                          ULONG* defaultUID,
+                          WSL_DISTRIBUTION_FLAGS* wslDistributionFlags,
+                          std::vector<std::string>* environment,
+                          FILETIME* keyWriteTime);
+
+    // Record the configuration read from WSL after GetConfiguration returned
+    // keyWriteTime.
+    void StoreConfiguration(const FILETIME& keyWriteTime,
+                            ULONG distributionVersion,
+                            ULONG defaultUID,
+                            WSL_DISTRIBUTION_FLAGS wslDistributionFlags,
+                            const std::vector<std::string>& environment);
+}
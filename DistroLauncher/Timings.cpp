@@ -0,0 +1,208 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+// Version of the JSON report, bumped whenever its layout changes.
+#define TIMINGS_REPORT_VERSION 1
+
+// The GUID is derived from the name of the provider, so that tools can enable
+// it by name: 932d84b1-f26c-5777-881e-4247e85869a3.
+TRACELOGGING_DEFINE_PROVIDER(g_traceProvider,
+                             "Ubuntu.WSL.DistroLauncher",
+                             (0x932d84b1, 0xf26c, 0x5777, 0x88, 0x1e, 0x42, 0x47, 0xe8, 0x58, 0x69, 0xa3));
+
+namespace {
+    struct Phase
+    {
+        PCSTR name;
+        unsigned int depth;
+        LONGLONG start;
+        LONGLONG end;
+        HRESULT result;
+    };
+
+    // Phases are only recorded from the main thread, in the order they start.
+    bool g_enabled = false;
+    std::wstring g_jsonPath;
+    LARGE_INTEGER g_frequency;
+    LARGE_INTEGER g_origin;
+    unsigned int g_depth = 0;
+    std::vector<Phase> g_phases;
+
+    LONGLONG Now();
+    LONGLONG TraceNow();
+    ULONGLONG ToMicroseconds(LONGLONG ticks);
+    void UnregisterProvider();
+    void Report();
+    HRESULT WriteJson(const std::wstring& path);
+}
+
+void Timings::RegisterProvider()
+{
+    QueryPerformanceFrequency(&g_frequency);
+    TraceLoggingRegister(g_traceProvider);
+    atexit(UnregisterProvider);
+}
+
+void Timings::TraceCommand(std::wstring_view command)
+{
+    TraceLoggingWrite(g_traceProvider,
+                      "Command",
+                      TraceLoggingCountedWideString(command.data(), (USHORT)command.size(), "Command"),
+                      TraceLoggingWideString(DistributionInfo::Name.c_str(), "Distribution"));
+}
+
+void Timings::Enable(std::wstring_view jsonPath)
+{
+    if (!g_enabled) {
+        QueryPerformanceFrequency(&g_frequency);
+        QueryPerformanceCounter(&g_origin);
+        atexit(Report);
+    }
+
+    g_enabled = true;
+    g_jsonPath = jsonPath;
+}
+
+Timings::Scope::Scope(PCSTR name) :
+    _name(name),
+    _index(SIZE_MAX),
+    _traceStart(0),
+    _result(S_OK)
+{
+    // Phases are only timed for tracing while someone is listening.
+    if (TraceLoggingProviderEnabled(g_traceProvider, 0, 0)) {
+        _traceStart = TraceNow();
+        TraceLoggingWrite(g_traceProvider,
+                          "PhaseStart",
+                          TraceLoggingOpcode(WINEVENT_OPCODE_START),
+                          TraceLoggingString(name, "Phase"),
+                          TraceLoggingUInt32(g_depth, "Depth"));
+    }
+
+    if (g_enabled) {
+        _index = g_phases.size();
+        g_phases.push_back({name, g_depth, Now(), 0, S_OK});
+        g_depth += 1;
+    }
+}
+
+Timings::Scope::~Scope()
+{
+    if (_index != SIZE_MAX) {
+        g_phases[_index].end = Now();
+        g_depth -= 1;
+    }
+
+    if (_traceStart != 0) {
+        TraceLoggingWrite(g_traceProvider,
+                          "PhaseStop",
+                          TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+                          TraceLoggingString(_name, "Phase"),
+                          TraceLoggingHResult(_result, "Result"),
+                          TraceLoggingUInt64(ToMicroseconds(TraceNow() - _traceStart), "DurationUs"));
+    }
+}
+
+void Timings::Scope::SetResult(HRESULT hr)
+{
+    _result = hr;
+    if (_index != SIZE_MAX) {
+        g_phases[_index].result = hr;
+    }
+}
+
+namespace {
+    LONGLONG Now()
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return now.QuadPart - g_origin.QuadPart;
+    }
+
+    LONGLONG TraceNow()
+    {
+        // Never 0, which marks scopes that are not traced.
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return std::max<LONGLONG>(now.QuadPart, 1);
+    }
+
+    ULONGLONG ToMicroseconds(LONGLONG ticks)
+    {
+        // Split the conversion to avoid overflowing for long running phases.
+        const ULONGLONG seconds = ticks / g_frequency.QuadPart;
+        const ULONGLONG remainder = ticks % g_frequency.QuadPart;
+        return (seconds * 1000000) + ((remainder * 1000000) / g_frequency.QuadPart);
+    }
+
+    void UnregisterProvider()
+    {
+        TraceLoggingUnregister(g_traceProvider);
+    }
+
+    void Report()
+    {
+        // Phases still running, if the launcher exits early, end here.
+        const LONGLONG end = Now();
+        for (auto& phase : g_phases) {
+            if (phase.end == 0) {
+                phase.end = end;
+            }
+        }
+
+        Console::Batch batch;
+        Helpers::PrintMessage(MSG_TIMINGS_HEADER);
+        for (const auto& phase : g_phases) {
+            const std::string name = std::string(phase.depth * 2, ' ') + phase.name;
+            const ULONGLONG duration = ToMicroseconds(phase.end - phase.start);
+            Helpers::PrintMessage(MSG_TIMINGS_PHASE, name.c_str(), (ULONG)(duration / 1000), (ULONG)(duration % 1000), phase.result);
+        }
+
+        if (!g_jsonPath.empty()) {
+            HRESULT hr = WriteJson(g_jsonPath);
+            if (FAILED(hr)) {
+                Helpers::PrintMessage(MSG_TIMINGS_WRITE_FAILED, g_jsonPath.c_str(), hr);
+            }
+        }
+    }
+
+    HRESULT WriteJson(const std::wstring& path)
+    {
+        // Phase names are identifiers from the launcher itself and the
+        // distribution name is a registry key name, so neither needs escaping.
+        std::string distributionName(DistributionInfo::Name.size() * 3, '\0');
+        distributionName.resize(WideCharToMultiByte(CP_UTF8, 0, DistributionInfo::Name.c_str(), (int)DistributionInfo::Name.size(), distributionName.data(), (int)distributionName.size(), nullptr, nullptr));
+
+        std::string json = "{\"version\":" + std::to_string(TIMINGS_REPORT_VERSION) + ",\"distribution\":\"" + distributionName + "\",\"phases\":[";
+        for (size_t index = 0; index < g_phases.size(); index += 1) {
+            const Phase& phase = g_phases[index];
+            char result[11];
+            sprintf_s(result, "0x%08lx", (ULONG)phase.result);
+            json += (index == 0) ? "\n" : ",\n";
+            json += "{\"name\":\"" + std::string(phase.name) + "\"";
+            json += ",\"depth\":" + std::to_string(phase.depth);
+            json += ",\"start_us\":" + std::to_string(ToMicroseconds(phase.start));
+            json += ",\"duration_us\":" + std::to_string(ToMicroseconds(phase.end - phase.start));
+            json += ",\"result\":\"" + std::string(result) + "\"}";
+        }
+
+        json += "\n]}\n";
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        HRESULT hr = S_OK;
+        DWORD written;
+        if (!WriteFile(file, json.data(), (DWORD)json.size(), &written, nullptr)) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        CloseHandle(file);
+        return hr;
+    }
+}
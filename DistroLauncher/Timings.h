@@ -0,0 +1,41 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+// Every phase is also traced with TraceLogging, as a start and a stop event of
+// the Ubuntu.WSL.DistroLauncher provider, whether or not it is recorded.
+namespace Timings
+{
+    // Register the TraceLogging provider, until the launcher exits.
+    void RegisterProvider();
+
+    // Trace the command the launcher was started with.
+    void TraceCommand(std::wstring_view command);
+
+    // Start recording phases. The summary table is printed when the launcher
+    // exits and, if jsonPath is not empty, a JSON report is written there too.
+    void Enable(std::wstring_view jsonPath);
+
+    // Measures a phase from construction to destruction.
+    class Scope
+    {
+      public:
+        Scope(PCSTR name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        // Record the result of the phase.
+        void SetResult(HRESULT hr);
+
+      private:
+        PCSTR _name;
+        size_t _index;
+        LONGLONG _traceStart;
+        HRESULT _result;
+    };
+}
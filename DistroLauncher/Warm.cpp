@@ -0,0 +1,41 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+HRESULT Warm::Run(ULONG idleSeconds)
+{
+    Timings::Scope timing("warm");
+
+    // WslLaunch returns once the process runs in the distribution, which
+    // means that the utility VM and the distribution have booted. The process
+    // then keeps the distribution running for the idle window.
+    SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
+    HANDLE nul = CreateFileW(L"NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, nullptr);
+    if (nul == INVALID_HANDLE_VALUE) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    const std::wstring command = L"exec sleep " + std::to_wstring(idleSeconds);
+    HANDLE process;
+    HRESULT hr = g_wslApi.WslLaunch(command.c_str(), false, nul, nul, nul, &process);
+    QueryPerformanceCounter(&end);
+    CloseHandle(nul);
+    if (FAILED(hr)) {
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    const ULONG milliseconds = (ULONG)(((end.QuadPart - start.QuadPart) * 1000) / frequency.QuadPart);
+    Helpers::PrintMessage(MSG_WARM_READY, milliseconds, idleSeconds);
+    WaitForSingleObject(process, INFINITE);
+    CloseHandle(process);
+    return hr;
+}
@@ -0,0 +1,16 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+namespace Warm
+{
+    // How long the distribution is kept running by default, in seconds.
+    const ULONG DefaultIdleSeconds = 300;
+
+    // Boot the distribution in the background, report when it is ready and
+    // keep it running for idleSeconds.
+    HRESULT Run(ULONG idleSeconds);
+}
@@ -6,17 +6,31 @@
 #include "stdafx.h"
 #include "WslApiLoader.h"
 
+// Size of the buffer of each captured stream.
+#define CAPTURE_BUFFER_SIZE (64 * 1024)
+
+namespace {
+    // A captured output stream of a process, read with overlapped I/O.
+    struct CaptureStream
+    {
+        HANDLE pipe = INVALID_HANDLE_VALUE;
+        OVERLAPPED overlapped{};
+        std::vector<char> buffer;
+        std::string* output = nullptr;
+        bool reading = false;
+    };
+
+    HRESULT OpenCaptureStream(const std::wstring& distributionName, std::string* output, CaptureStream* stream, HANDLE* writeEnd);
+    void StartRead(CaptureStream* stream);
+    void CompleteRead(CaptureStream* stream);
+    void CloseCaptureStream(CaptureStream* stream);
+}
+
+// wslapi.dll and its entry points are only resolved when first needed, so
+// commands such as help never pay for loading it.
 WslApiLoader::WslApiLoader(const std::wstring& distributionName) :
     _distributionName(distributionName)
 {
-    _wslApiDll = LoadLibraryEx(L"wslapi.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
-    if (_wslApiDll != nullptr) {
-        _isDistributionRegistered = (WSL_IS_DISTRIBUTION_REGISTERED)GetProcAddress(_wslApiDll, "WslIsDistributionRegistered");
-        _registerDistribution = (WSL_REGISTER_DISTRIBUTION)GetProcAddress(_wslApiDll, "WslRegisterDistribution");
-        _configureDistribution = (WSL_CONFIGURE_DISTRIBUTION)GetProcAddress(_wslApiDll, "WslConfigureDistribution");
-        _launchInteractive = (WSL_LAUNCH_INTERACTIVE)GetProcAddress(_wslApiDll, "WslLaunchInteractive");
-        _launch = (WSL_LAUNCH)GetProcAddress(_wslApiDll, "WslLaunch");
-    }
 }
 
 WslApiLoader::~WslApiLoader()
@@ -28,22 +42,43 @@ WslApiLoader::~WslApiLoader()
 
 BOOL WslApiLoader::WslIsOptionalComponentInstalled()
 {
-    return ((_wslApiDll != nullptr) && 
-            (_isDistributionRegistered != nullptr) &&
-            (_registerDistribution != nullptr) &&
-            (_configureDistribution != nullptr) &&
-            (_launchInteractive != nullptr) &&
-            (_launch != nullptr));
+    // A distribution cannot be registered without it.
+    if (StateCache::IsRegistered()) {
+        return true;
+    }
+
+    // Every entry point used by the launcher ships in the same release of
+    // wslapi.dll, so only the one needed next is resolved here; the others
+    // report ERROR_PROC_NOT_FOUND on first use should they ever be missing.
+    return (Resolve(_isDistributionRegistered, "WslIsDistributionRegistered") != nullptr);
 }
 
 BOOL WslApiLoader::WslIsDistributionRegistered()
 {
-    return _isDistributionRegistered(_distributionName.c_str());
+    if (StateCache::IsRegistered()) {
+        return true;
+    }
+
+    Timings::Scope timing("WslIsDistributionRegistered");
+    const auto isDistributionRegistered = Resolve(_isDistributionRegistered, "WslIsDistributionRegistered");
+    const bool registered = ((isDistributionRegistered != nullptr) && (isDistributionRegistered(_distributionName.c_str())));
+    if (registered) {
+        StateCache::StoreRegistration();
+    }
+
+    return registered;
 }
 
-HRESULT WslApiLoader::WslRegisterDistribution()
+HRESULT WslApiLoader::WslRegisterDistribution(PCWSTR tarGzFilename)
 {
-    HRESULT hr = _registerDistribution(_distributionName.c_str(), L"install.tar.gz");
+    Timings::Scope timing("WslRegisterDistribution");
+    const auto registerDistribution = Resolve(_registerDistribution, "WslRegisterDistribution");
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND);
+    if (registerDistribution != nullptr) {
+        hr = registerDistribution(_distributionName.c_str(), tarGzFilename);
+    }
+
+    timing.SetResult(hr);
     if (FAILED(hr)) {
         Helpers::PrintMessage(MSG_WSL_REGISTER_DISTRIBUTION_FAILED, hr);
     }
@@ -53,7 +88,14 @@ HRESULT WslApiLoader::WslRegisterDistribution()
 
 HRESULT WslApiLoader::WslConfigureDistribution(ULONG defaultUID, WSL_DISTRIBUTION_FLAGS wslDistributionFlags)
 {
-    HRESULT hr = _configureDistribution(_distributionName.c_str(), defaultUID, wslDistributionFlags);
+    Timings::Scope timing("WslConfigureDistribution");
+    const auto configureDistribution = Resolve(_configureDistribution, "WslConfigureDistribution");
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND);
+    if (configureDistribution != nullptr) {
+        hr = configureDistribution(_distributionName.c_str(), defaultUID, wslDistributionFlags);
+    }
+
+    timing.SetResult(hr);
     if (FAILED(hr)) {
         Helpers::PrintMessage(MSG_WSL_CONFIGURE_DISTRIBUTION_FAILED, hr);
     }
@@ -61,9 +103,51 @@ HRESULT WslApiLoader::WslConfigureDistribution(ULONG defaultUID, WSL_DISTRIBUTIO
     return hr;
 }
 
+HRESULT WslApiLoader::WslGetDistributionConfiguration(ULONG *distributionVersion, ULONG *defaultUID, WSL_DISTRIBUTION_FLAGS *wslDistributionFlags, std::vector<std::string> *environment)
+{
+    FILETIME keyWriteTime;
+    if (StateCache::GetConfiguration(distributionVersion, defaultUID, wslDistributionFlags, environment, &keyWriteTime)) {
+        return S_OK;
+    }
+
+    Timings::Scope timing("WslGetDistributionConfiguration");
+    const auto getDistributionConfiguration = Resolve(_getDistributionConfiguration, "WslGetDistributionConfiguration");
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND);
+    PSTR* variables = nullptr;
+    ULONG variableCount = 0;
+    if (getDistributionConfiguration != nullptr) {
+        hr = getDistributionConfiguration(_distributionName.c_str(), distributionVersion, defaultUID, wslDistributionFlags, &variables, &variableCount);
+    }
+
+    if (SUCCEEDED(hr)) {
+        environment->clear();
+        for (ULONG index = 0; index < variableCount; index += 1) {
+            environment->emplace_back(variables[index]);
+            CoTaskMemFree(variables[index]);
+        }
+
+        CoTaskMemFree(variables);
+        StateCache::StoreConfiguration(keyWriteTime, *distributionVersion, *defaultUID, *wslDistributionFlags, *environment);
+    }
+
+    timing.SetResult(hr);
+    if (FAILED(hr)) {
+        Helpers::PrintMessage(MSG_WSL_GET_DISTRIBUTION_CONFIGURATION_FAILED, hr);
+    }
+
+    return hr;
+}
+
 HRESULT WslApiLoader::WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkingDirectory, DWORD *exitCode)
 {
-    HRESULT hr = _launchInteractive(_distributionName.c_str(), command, useCurrentWorkingDirectory, exitCode);
+    Timings::Scope timing("WslLaunchInteractive");
+    const auto launchInteractive = Resolve(_launchInteractive, "WslLaunchInteractive");
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND);
+    if (launchInteractive != nullptr) {
+        hr = launchInteractive(_distributionName.c_str(), command, useCurrentWorkingDirectory, exitCode);
+    }
+
+    timing.SetResult(hr);
     if (FAILED(hr)) {
         Helpers::PrintMessage(MSG_WSL_LAUNCH_INTERACTIVE_FAILED, command, hr);
     }
@@ -73,10 +157,217 @@ HRESULT WslApiLoader::WslLaunchInteractive(PCWSTR command, BOOL useCurrentWorkin
 
 HRESULT WslApiLoader::WslLaunch(PCWSTR command, BOOL useCurrentWorkingDirectory, HANDLE stdIn, HANDLE stdOut, HANDLE stdErr, HANDLE *process)
 {
-    HRESULT hr = _launch(_distributionName.c_str(), command, useCurrentWorkingDirectory, stdIn, stdOut, stdErr, process);
+    Timings::Scope timing("WslLaunch");
+    const auto launch = Resolve(_launch, "WslLaunch");
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND);
+    if (launch != nullptr) {
+        hr = launch(_distributionName.c_str(), command, useCurrentWorkingDirectory, stdIn, stdOut, stdErr, process);
+    }
+
+    timing.SetResult(hr);
     if (FAILED(hr)) {
         Helpers::PrintMessage(MSG_WSL_LAUNCH_FAILED, command, hr);
     }
 
     return hr;
 }
+
+HRESULT WslApiLoader::WslLaunchCapture(PCWSTR command, BOOL useCurrentWorkingDirectory, HANDLE stdIn, std::string *stdOut, std::string *stdErr, DWORD timeout, HANDLE cancelEvent, DWORD *exitCode)
+{
+    Timings::Scope timing("WslLaunchCapture");
+    CaptureStream output;
+    CaptureStream error;
+    HANDLE outputWrite = nullptr;
+    HANDLE errorWrite = nullptr;
+    HRESULT hr = OpenCaptureStream(_distributionName, stdOut, &output, &outputWrite);
+    if ((SUCCEEDED(hr)) && (stdErr != nullptr)) {
+        hr = OpenCaptureStream(_distributionName, stdErr, &error, &errorWrite);
+    }
+
+    HANDLE process = nullptr;
+    if (SUCCEEDED(hr)) {
+        hr = WslLaunch(command, useCurrentWorkingDirectory, stdIn, outputWrite, (stdErr != nullptr) ? errorWrite : GetStdHandle(STD_ERROR_HANDLE), &process);
+    }
+
+    // Close our copies of the write ends so that reading stops once the
+    // command has exited.
+    if (outputWrite != nullptr) {
+        CloseHandle(outputWrite);
+    }
+
+    if (errorWrite != nullptr) {
+        CloseHandle(errorWrite);
+    }
+
+    if (SUCCEEDED(hr)) {
+        StartRead(&output);
+        StartRead(&error);
+    }
+
+    const ULONGLONG deadline = GetTickCount64() + timeout;
+    bool exited = false;
+    while ((SUCCEEDED(hr)) && ((!exited) || (output.reading) || (error.reading))) {
+        HANDLE handles[4];
+        DWORD count = 0;
+        if (output.reading) {
+            handles[count++] = output.overlapped.hEvent;
+        }
+
+        if (error.reading) {
+            handles[count++] = error.overlapped.hEvent;
+        }
+
+        if (!exited) {
+            handles[count++] = process;
+        }
+
+        if (cancelEvent != nullptr) {
+            handles[count++] = cancelEvent;
+        }
+
+        DWORD remaining = INFINITE;
+        if (timeout != INFINITE) {
+            const ULONGLONG now = GetTickCount64();
+            remaining = (now < deadline) ? (DWORD)(deadline - now) : 0;
+        }
+
+        const DWORD wait = WaitForMultipleObjects(count, handles, false, remaining);
+        if (wait == WAIT_TIMEOUT) {
+            hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+
+        } else if (wait >= (WAIT_OBJECT_0 + count)) {
+            hr = (wait == WAIT_FAILED) ? HRESULT_FROM_WIN32(GetLastError()) : E_UNEXPECTED;
+
+        } else if (handles[wait - WAIT_OBJECT_0] == cancelEvent) {
+            hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
+
+        } else if (handles[wait - WAIT_OBJECT_0] == process) {
+            exited = true;
+
+        } else if (handles[wait - WAIT_OBJECT_0] == output.overlapped.hEvent) {
+            CompleteRead(&output);
+
+        } else {
+            CompleteRead(&error);
+        }
+    }
+
+    if (process != nullptr) {
+        if (!exited) {
+            TerminateProcess(process, 1);
+
+        } else if ((SUCCEEDED(hr)) && (!GetExitCodeProcess(process, exitCode))) {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        CloseHandle(process);
+    }
+
+    CloseCaptureStream(&output);
+    CloseCaptureStream(&error);
+    timing.SetResult(hr);
+    return hr;
+}
+
+HMODULE WslApiLoader::LoadWslApi()
+{
+    std::call_once(_wslApiLoaded, [&] {
+        _wslApiDll = LoadLibraryEx(L"wslapi.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+    });
+
+    return _wslApiDll;
+}
+
+template <typename T>
+T WslApiLoader::Resolve(EntryPoint<T>& entryPoint, PCSTR name)
+{
+    std::call_once(entryPoint.resolved, [&] {
+        HMODULE wslApiDll = LoadWslApi();
+        if (wslApiDll != nullptr) {
+            entryPoint.function = (T)GetProcAddress(wslApiDll, name);
+        }
+    });
+
+    return entryPoint.function;
+}
+
+namespace {
+    HRESULT OpenCaptureStream(const std::wstring& distributionName, std::string* output, CaptureStream* stream, HANDLE* writeEnd)
+    {
+        // Anonymous pipes do not support overlapped I/O, so use a named pipe
+        // unique to this capture.
+        static LONG captureCount = 0;
+        const std::wstring name = L"\\\\.\\pipe\\" + distributionName + L"-capture-" +
+                                  std::to_wstring(GetCurrentProcessId()) + L"-" +
+                                  std::to_wstring(InterlockedIncrement(&captureCount));
+
+        stream->output = output;
+        stream->buffer.resize(CAPTURE_BUFFER_SIZE);
+        stream->overlapped.hEvent = CreateEventW(nullptr, true, false, nullptr);
+        if (stream->overlapped.hEvent == nullptr) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        stream->pipe = CreateNamedPipeW(name.c_str(),
+                                        PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                        PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                        1,
+                                        0,
+                                        CAPTURE_BUFFER_SIZE,
+                                        0,
+                                        nullptr);
+
+        if (stream->pipe == INVALID_HANDLE_VALUE) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, true};
+        *writeEnd = CreateFileW(name.c_str(), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, nullptr);
+        if (*writeEnd == INVALID_HANDLE_VALUE) {
+            *writeEnd = nullptr;
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        return S_OK;
+    }
+
+    void StartRead(CaptureStream* stream)
+    {
+        // Completion is always reported through the event, even when the read
+        // completes right away. A failure means that the command has exited.
+        if (stream->pipe != INVALID_HANDLE_VALUE) {
+            stream->reading = ((ReadFile(stream->pipe, stream->buffer.data(), (DWORD)stream->buffer.size(), nullptr, &stream->overlapped)) ||
+                               (GetLastError() == ERROR_IO_PENDING));
+        }
+    }
+
+    void CompleteRead(CaptureStream* stream)
+    {
+        DWORD bytesRead;
+        stream->reading = false;
+        if (!GetOverlappedResult(stream->pipe, &stream->overlapped, &bytesRead, false)) {
+            return;
+        }
+
+        stream->output->append(stream->buffer.data(), bytesRead);
+        StartRead(stream);
+    }
+
+    void CloseCaptureStream(CaptureStream* stream)
+    {
+        // Wait for a pending read to be cancelled before its buffer goes away.
+        DWORD bytesRead;
+        if (stream->reading) {
+            CancelIoEx(stream->pipe, &stream->overlapped);
+            GetOverlappedResult(stream->pipe, &stream->overlapped, &bytesRead, true);
+        }
+
+        if (stream->pipe != INVALID_HANDLE_VALUE) {
+            CloseHandle(stream->pipe);
+        }
+
+        if (stream->overlapped.hEvent != nullptr) {
+            CloseHandle(stream->overlapped.hEvent);
+        }
+    }
+}
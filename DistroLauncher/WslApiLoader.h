@@ -28,11 +28,19 @@ class WslApiLoader
 
     BOOL WslIsDistributionRegistered();
 
-    HRESULT WslRegisterDistribution();
+    HRESULT WslRegisterDistribution(PCWSTR tarGzFilename);
 
     HRESULT WslConfigureDistribution(ULONG defaultUID,
                                      WSL_DISTRIBUTION_FLAGS wslDistributionFlags);
 
+    // Read the configuration of the distribution from the registry, without
+    // starting it. The environment strings are copied into environment and
+    // the buffers allocated by wslapi.dll are freed.
+    HRESULT WslGetDistributionConfiguration(ULONG *distributionVersion,
+                                            ULONG *defaultUID,
+                                            WSL_DISTRIBUTION_FLAGS *wslDistributionFlags,
+                                            std::vector<std::string> *environment);
+
     HRESULT WslLaunchInteractive(PCWSTR command,
                                  BOOL useCurrentWorkingDirectory,
                                  DWORD *exitCode);
@@ -44,14 +52,43 @@ class WslApiLoader
                       HANDLE stdErr,
                       HANDLE *process);
 
+    // Run a command and capture its stdout, and its stderr unless stdErr is
+    // null, in which case it goes to the console. Both are drained at once
+    // with overlapped I/O, so the command never blocks on a full pipe. The
+    // command is terminated if it is still running after timeout
+    // milliseconds, or once cancelEvent, if any, is signaled.
+    HRESULT WslLaunchCapture(PCWSTR command,
+                             BOOL useCurrentWorkingDirectory,
+                             HANDLE stdIn,
+                             std::string *stdOut,
+                             std::string *stdErr,
+                             DWORD timeout,
+                             HANDLE cancelEvent,
+                             DWORD *exitCode);
+
   private:
+    // An entry point of wslapi.dll, resolved on first use.
+    template <typename T>
+    struct EntryPoint
+    {
+        std::once_flag resolved;
+        T function = nullptr;
+    };
+
+    HMODULE LoadWslApi();
+
+    template <typename T>
+    T Resolve(EntryPoint<T>& entryPoint, PCSTR name);
+
     std::wstring _distributionName;
-    HMODULE _wslApiDll;
-    WSL_IS_DISTRIBUTION_REGISTERED _isDistributionRegistered;
-    WSL_REGISTER_DISTRIBUTION _registerDistribution;
-    WSL_CONFIGURE_DISTRIBUTION _configureDistribution;
-    WSL_LAUNCH_INTERACTIVE _launchInteractive;
-    WSL_LAUNCH _launch;
+    std::once_flag _wslApiLoaded;
+    HMODULE _wslApiDll = nullptr;
+    EntryPoint<WSL_IS_DISTRIBUTION_REGISTERED> _isDistributionRegistered;
+    EntryPoint<WSL_REGISTER_DISTRIBUTION> _registerDistribution;
+    EntryPoint<WSL_CONFIGURE_DISTRIBUTION> _configureDistribution;
+    EntryPoint<WSL_GET_DISTRIBUTION_CONFIGURATION> _getDistributionConfiguration;
+    EntryPoint<WSL_LAUNCH_INTERACTIVE> _launchInteractive;
+    EntryPoint<WSL_LAUNCH> _launch;
 };
 
 extern WslApiLoader g_wslApi;
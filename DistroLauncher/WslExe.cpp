@@ -0,0 +1,96 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#include "stdafx.h"
+
+namespace {
+    HRESULT CreateWslProcess(const std::wstring& arguments, HANDLE stdOut, PROCESS_INFORMATION* process);
+}
+
+std::wstring WslExe::QuoteArgument(std::wstring_view argument)
+{
+    // Follow the rules of CommandLineToArgvW: backslashes are only special
+    // when they precede a quote.
+    std::wstring quoted = L"\"";
+    size_t backslashes = 0;
+    for (const wchar_t ch : argument) {
+        if (ch == L'\\') {
+            backslashes += 1;
+            continue;
+        }
+
+        if (ch == L'"') {
+            backslashes = (backslashes * 2) + 1;
+        }
+
+        quoted.append(backslashes, L'\\');
+        quoted += ch;
+        backslashes = 0;
+    }
+
+    quoted.append(backslashes * 2, L'\\');
+    quoted += L"\"";
+    return quoted;
+}
+
+HRESULT WslExe::Run(const std::wstring& arguments, DWORD* exitCode)
+{
+    Timings::Scope timing("wsl.exe");
+    PROCESS_INFORMATION process;
+    HRESULT hr = CreateWslProcess(arguments, nullptr, &process);
+    if (FAILED(hr)) {
+        timing.SetResult(hr);
+        return hr;
+    }
+
+    WaitForSingleObject(process.hProcess, INFINITE);
+    if (!GetExitCodeProcess(process.hProcess, exitCode)) {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    CloseHandle(process.hThread);
+    CloseHandle(process.hProcess);
+    timing.SetResult(hr);
+    return hr;
+}
+
+HRESULT WslExe::Launch(const std::wstring& arguments, HANDLE stdOut, HANDLE* process)
+{
+    PROCESS_INFORMATION processInformation;
+    HRESULT hr = CreateWslProcess(arguments, stdOut, &processInformation);
+    if (SUCCEEDED(hr)) {
+        CloseHandle(processInformation.hThread);
+        *process = processInformation.hProcess;
+    }
+
+    return hr;
+}
+
+namespace {
+    HRESULT CreateWslProcess(const std::wstring& arguments, HANDLE stdOut, PROCESS_INFORMATION* process)
+    {
+        std::wstring path(MAX_PATH, L'\0');
+        path.resize(GetSystemDirectoryW(path.data(), (UINT)path.size()));
+        if (path.empty()) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        path += L"\\wsl.exe";
+        std::wstring commandLine = WslExe::QuoteArgument(path) + L" " + arguments;
+        STARTUPINFOW startupInfo{sizeof(startupInfo)};
+        if (stdOut != nullptr) {
+            startupInfo.dwFlags = STARTF_USESTDHANDLES;
+            startupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+            startupInfo.hStdOutput = stdOut;
+            startupInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+        }
+
+        if (!CreateProcessW(path.c_str(), commandLine.data(), nullptr, nullptr, (stdOut != nullptr), 0, nullptr, nullptr, &startupInfo, process)) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        return S_OK;
+    }
+}
@@ -0,0 +1,21 @@
+//
+//    Copyright (C) Microsoft.  All rights reserved.
+// Licensed under the terms described in the LICENSE file in the root of this project.
+//
+
+#pragma once
+
+// Runs wsl.exe for the operations the WSL API does not expose.
+namespace WslExe
+{
+    // Quote an argument so that wsl.exe receives it unchanged.
+    std::wstring QuoteArgument(std::wstring_view argument);
+
+    // Run wsl.exe with the given, already quoted, arguments on the console of
+    // the launcher and wait for it to exit.
+    HRESULT Run(const std::wstring& arguments, DWORD* exitCode);
+
+    // Start wsl.exe with the given, already quoted, arguments and its stdout
+    // connected to stdOut, which must be inheritable, and return its process.
+    HRESULT Launch(const std::wstring& arguments, HANDLE stdOut, HANDLE* process);
+}
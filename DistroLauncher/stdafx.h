@@ -11,24 +11,50 @@
 
 #include "targetver.h"
 
+#define NOMINMAX
+
 #include <stdio.h>
 #include <tchar.h>
 #include <Windows.h>
+#include <compressapi.h>
+#include <appmodel.h>
 #include <stdio.h>
 #include <conio.h>
 #include <io.h>
-#include <iostream>
 #include <string>
 #include <memory>
 #include <assert.h>
-#include <locale>
-#include <codecvt>
 #include <string_view>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <random>
 #include <wslapi.h>
+#include <TraceLoggingProvider.h>
+#include <winmeta.h>
 #include "WslApiLoader.h"
 #include "Helpers.h"
+#include "Console.h"
 #include "DistributionInfo.h"
+#include "PackedRootfs.h"
+#include "RootfsImport.h"
+#include "Timings.h"
+#include "Batch.h"
+#include "Warm.h"
+#include "WslExe.h"
+#include "ParallelInstall.h"
+#include "InstallProgress.h"
+#include "DeltaUpdate.h"
+#include "Provision.h"
+#include "FirstBoot.h"
+#include "Maintain.h"
+#include "StateCache.h"
+#include "Export.h"
 
 // Message strings compiled from .MC file.
 #include "messages.h"
@@ -0,0 +1,88 @@
+param (
+    [Parameter(Mandatory = $true, HelpMessage = "The rootfs tarball the training installs")]
+    [string]$Rootfs,
+    [Parameter(HelpMessage = "The platform to build: x64 or ARM64. Training runs the launcher, so it must match the machine")]
+    [ValidateSet("x64", "ARM64")]
+    [string]$Platform = "x64",
+    [Parameter(HelpMessage = "The path to MSBuild.exe")]
+    [string]$MSBuild = "msbuild.exe"
+)
+
+# Builds a profile-guided optimized Release launcher in three steps: an instrumented build,
+# training runs of the common commands, and the final build optimized with their profiles.
+# Training registers and unregisters the distro under its development name, so it must not
+# be run while that distro is installed.
+
+$ErrorActionPreference = "Stop"
+
+$Solution = "${PSScriptRoot}\DistroLauncher.sln"
+$OutDir = "${PSScriptRoot}\${Platform}\Release"
+$Launcher = "${OutDir}\launcher.exe"
+$Distro = "UbuntuDev.WslID.Dev"
+
+function Invoke-Build {
+    param (
+        [Parameter(Mandatory=$true)] [string]$Pgo
+    )
+
+    & "${MSBuild}" "${Solution}" /t:Build /m /nr:false "/p:Configuration=Release;Platform=${Platform};LauncherPgo=${Pgo}"
+    if ($LASTEXITCODE -ne 0) {
+        throw "Build with LauncherPgo=${Pgo} failed"
+    }
+}
+
+# Get-PgoRuntime returns the path of the runtime instrumented binaries need, from the
+# latest Visual Studio installation.
+function Get-PgoRuntime {
+    $vswhere = "${env:ProgramFiles(x86)}\Microsoft Visual Studio\Installer\vswhere.exe"
+    $runtime = & "${vswhere}" -latest -find "VC\Tools\MSVC\*\bin\Host${Platform}\${Platform}\pgort140.dll" | Select-Object -First 1
+    if ("${runtime}" -eq "") {
+        throw "Could not find pgort140.dll for ${Platform}"
+    }
+    return $runtime
+}
+
+# Invoke-Training runs the instrumented launcher through the paths that matter for startup:
+# help, a first install, run and config. Each run adds a profile to the output directory.
+function Invoke-Training {
+    $training = Join-Path ([System.IO.Path]::GetTempPath()) "launcher-pgo-${Platform}"
+    Remove-Item -Recurse -Force "${training}" -ErrorAction SilentlyContinue
+    New-Item -Type Directory -Force "${training}" | Out-Null
+
+    # The launcher imports the rootfs next to itself, and writes its profiles to VCPROFILE_PATH.
+    Copy-Item "${Launcher}" "${training}\launcher.exe"
+    Copy-Item (Get-PgoRuntime) "${training}\pgort140.dll"
+    Copy-Item "${Rootfs}" "${training}\install.tar.gz"
+    Remove-Item -Force "${OutDir}\launcher*.pgc" -ErrorAction SilentlyContinue
+    $env:VCPROFILE_PATH = "${OutDir}"
+
+    $scenarios = @(
+        @("help"),
+        @("install", "--root"),
+        @("run", "true"),
+        @("run", "echo", "trained"),
+        @("config", "--show"),
+        @("config", "--default-user", "root"),
+        @("--trace-timings", "run", "true")
+    )
+
+    try {
+        foreach ($scenario in $scenarios) {
+            Write-Output "Training: launcher $($scenario -join ' ')"
+            & "${training}\launcher.exe" @scenario
+            if ($LASTEXITCODE -ne 0) {
+                throw "Training scenario '$($scenario -join ' ')' failed"
+            }
+        }
+    } finally {
+        wsl.exe --unregister "${Distro}" | Out-Null
+        Remove-Item Env:\VCPROFILE_PATH
+        Remove-Item -Recurse -Force "${training}" -ErrorAction SilentlyContinue
+    }
+}
+
+Invoke-Build -Pgo "Instrument"
+Invoke-Training
+Invoke-Build -Pgo "Optimize"
+
+Write-Output "Created profile-guided optimized appx in ${OutDir}\DistroLauncher-Appx\"
@@ -59,10 +59,19 @@ if (%1) == (clean) (
 if (%1) == (rel) (
     set _MSBUILD_CONFIG=Release
 )
+rem pgo <rootfs>: profile-guided optimized Release build, trained by installing <rootfs>
+if (%1) == (pgo) (
+    set _PGO_ROOTFS=%2
+    shift
+)
 shift
 goto :ARGS_LOOP
 
 :POST_ARGS_LOOP
+if defined _PGO_ROOTFS (
+    powershell.exe -NoProfile -ExecutionPolicy Bypass -File %~dp0\build-pgo.ps1 -MSBuild %MSBUILD% -Rootfs %_PGO_ROOTFS%
+    goto :EXIT
+)
 %MSBUILD% %~dp0\DistroLauncher.sln /t:%_MSBUILD_TARGET% /m /nr:true /p:Configuration=%_MSBUILD_CONFIG%;Platform=x64
 
 if (%ERRORLEVEL%) == (0) (
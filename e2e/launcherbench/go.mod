@@ -0,0 +1,3 @@
+module github.com/ubuntu/wsl/e2e/launcherbench
+
+go 1.21.5
@@ -0,0 +1,104 @@
+// Command launcherbench measures the latency of the distro launcher commands
+// and compares it against a stored baseline.
+//
+// The distro under test is unregistered at the start and at the end of the
+// run, so, like the end-to-end tests, it must not be used for anything else.
+package main
+
+import (
+	"context"
+	"flag"
+	"fmt"
+	"log"
+	"os"
+	"time"
+)
+
+// Defaults choosen based on the default state of the repository on git-clone.
+const defaultDistroName = "UbuntuDev.WslID.Dev"
+const defaultLauncherName = "UbuntuDev.LauncherName.Dev.exe"
+
+var (
+	launcherName      = flag.String("launcher-name", defaultLauncherName, "WSL distro launcher under test.")
+	distroName        = flag.String("distro-name", defaultDistroName, "WSL distro instance registered for benchmarking.")
+	iterations        = flag.Int("iterations", 20, "Number of samples taken for each command.")
+	installIterations = flag.Int("install-iterations", 3, "Number of samples taken for the first-run install, which is much slower.")
+	output            = flag.String("output", "", "Write the report as JSON to this path, for instance meta/<AppID>/benchmarks.json.")
+	baseline          = flag.String("baseline", "", "Compare the results against this report and fail on regressions. Ignored if the file does not exist. It may be the same file as --output.")
+	tolerance         = flag.Float64("tolerance", 0.25, "Relative slowdown of p50 or p95 over the baseline that counts as a regression.")
+	timeout           = flag.Duration("timeout", 30*time.Minute, "Maximum duration of the whole run.")
+)
+
+func main() {
+	flag.Parse()
+	log.SetFlags(0)
+
+	if err := run(); err != nil {
+		log.Fatalf("Error: %v", err)
+	}
+}
+
+func run() (err error) {
+	ctx, cancel := context.WithTimeout(context.Background(), *timeout)
+	defer cancel()
+
+	if state, err := distroState(ctx); err != nil {
+		return err
+	} else if state != distroNotFound {
+		return fmt.Errorf("distro %q is registered. Make a backup and unregister it before running the benchmarks", *distroName)
+	}
+	defer func() {
+		if e := unregisterDistro(context.Background()); e != nil && err == nil {
+			err = e
+		}
+	}()
+
+	r := report{
+		Launcher:   *launcherName,
+		Distro:     *distroName,
+		Date:       time.Now().UTC().Format(time.RFC3339),
+		Iterations: *iterations,
+	}
+
+	for _, s := range scenarios() {
+		log.Printf("Running %s...", s.name)
+		results, err := s.measure(ctx)
+		if err != nil {
+			return fmt.Errorf("%s: %v", s.name, err)
+		}
+		r.Scenarios = append(r.Scenarios, results...)
+	}
+
+	r.print(os.Stdout)
+
+	// The baseline is read before the report is written, so that both can be
+	// the same file and the committed report is refreshed by the run.
+	var base report
+	hasBaseline := false
+	if *baseline != "" {
+		b, err := readReport(*baseline)
+		if os.IsNotExist(err) {
+			log.Printf("No baseline at %s: skipping comparison", *baseline)
+		} else if err != nil {
+			return err
+		} else {
+			base, hasBaseline = b, true
+		}
+	}
+
+	if *output != "" {
+		if err := r.write(*output); err != nil {
+			return err
+		}
+	}
+
+	if !hasBaseline {
+		return nil
+	}
+
+	if regressions := r.compare(os.Stdout, base, *tolerance); regressions > 0 {
+		return fmt.Errorf("%d regression(s) over baseline %s", regressions, *baseline)
+	}
+
+	return nil
+}
@@ -0,0 +1,143 @@
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"io"
+	"math"
+	"os"
+	"path/filepath"
+	"sort"
+	"text/tabwriter"
+	"time"
+)
+
+// report is the JSON document stored per release under meta/<AppID>/.
+type report struct {
+	Launcher   string    `json:"launcher"`
+	Distro     string    `json:"distro"`
+	Date       string    `json:"date"`
+	Iterations int       `json:"iterations"`
+	Scenarios  []summary `json:"scenarios"`
+}
+
+// summary holds the latency percentiles of a scenario, in milliseconds.
+type summary struct {
+	Name    string  `json:"name"`
+	Samples int     `json:"samples"`
+	Min     float64 `json:"min_ms"`
+	P50     float64 `json:"p50_ms"`
+	P95     float64 `json:"p95_ms"`
+	P99     float64 `json:"p99_ms"`
+	Max     float64 `json:"max_ms"`
+}
+
+// summarize returns the percentiles of a scenario, or false if it has no
+// samples, as when it ran for zero iterations.
+func summarize(name string, samples []time.Duration) (summary, bool) {
+	if len(samples) == 0 {
+		return summary{}, false
+	}
+
+	sorted := append([]time.Duration(nil), samples...)
+	sort.Slice(sorted, func(i, j int) bool { return sorted[i] < sorted[j] })
+
+	return summary{
+		Name:    name,
+		Samples: len(sorted),
+		Min:     milliseconds(sorted[0]),
+		P50:     milliseconds(percentile(sorted, 50)),
+		P95:     milliseconds(percentile(sorted, 95)),
+		P99:     milliseconds(percentile(sorted, 99)),
+		Max:     milliseconds(sorted[len(sorted)-1]),
+	}, true
+}
+
+// percentile returns the nearest-rank percentile p of sorted samples.
+func percentile(sorted []time.Duration, p float64) time.Duration {
+	rank := int(math.Ceil(p / 100 * float64(len(sorted))))
+	if rank < 1 {
+		rank = 1
+	}
+	return sorted[rank-1]
+}
+
+func milliseconds(d time.Duration) float64 {
+	return math.Round(float64(d.Microseconds())) / 1000
+}
+
+func (r report) print(w io.Writer) {
+	tw := tabwriter.NewWriter(w, 0, 0, 2, ' ', tabwriter.AlignRight)
+	fmt.Fprintln(tw, "Scenario\tSamples\tp50 (ms)\tp95 (ms)\tp99 (ms)\t")
+	for _, s := range r.Scenarios {
+		fmt.Fprintf(tw, "%s\t%d\t%.1f\t%.1f\t%.1f\t\n", s.Name, s.Samples, s.P50, s.P95, s.P99)
+	}
+	tw.Flush()
+}
+
+func (r report) write(path string) error {
+	data, err := json.MarshalIndent(r, "", "  ")
+	if err != nil {
+		return err
+	}
+
+	if err := os.MkdirAll(filepath.Dir(path), 0755); err != nil {
+		return fmt.Errorf("could not create report directory: %v", err)
+	}
+
+	// #nosec G306: the report is public.
+	if err := os.WriteFile(path, append(data, '\n'), 0644); err != nil {
+		return fmt.Errorf("could not write report: %v", err)
+	}
+	return nil
+}
+
+func readReport(path string) (report, error) {
+	var r report
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return r, err
+	}
+
+	if err := json.Unmarshal(data, &r); err != nil {
+		return r, fmt.Errorf("could not parse report %s: %v", path, err)
+	}
+	return r, nil
+}
+
+// compare prints the change of every scenario present in both reports and
+// returns how many of them regressed by more than tolerance.
+func (r report) compare(w io.Writer, base report, tolerance float64) (regressions int) {
+	baseByName := make(map[string]summary)
+	for _, s := range base.Scenarios {
+		baseByName[s.Name] = s
+	}
+
+	tw := tabwriter.NewWriter(w, 0, 0, 2, ' ', tabwriter.AlignRight)
+	fmt.Fprintln(tw, "Scenario\tp50 change\tp95 change\t\t")
+	for _, s := range r.Scenarios {
+		b, ok := baseByName[s.Name]
+		if !ok {
+			continue
+		}
+
+		p50, p95 := change(b.P50, s.P50), change(b.P95, s.P95)
+		verdict := ""
+		if p50 > tolerance || p95 > tolerance {
+			verdict = "REGRESSION"
+			regressions++
+		}
+		fmt.Fprintf(tw, "%s\t%+.1f%%\t%+.1f%%\t%s\t\n", s.Name, 100*p50, 100*p95, verdict)
+	}
+	tw.Flush()
+
+	return regressions
+}
+
+// change returns the relative change from before to after.
+func change(before, after float64) float64 {
+	if before == 0 {
+		return 0
+	}
+	return (after - before) / before
+}
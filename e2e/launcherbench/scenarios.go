@@ -0,0 +1,222 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"context"
+	"encoding/json"
+	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"regexp"
+	"time"
+)
+
+const distroNotFound = "DistroNotFound"
+
+// scenario is a command of the launcher timed repeatedly.
+type scenario struct {
+	name       string
+	iterations int
+
+	// setup, if set, runs before every sample and is not timed.
+	setup func(ctx context.Context) error
+
+	// args are passed to the launcher.
+	args []string
+
+	// traceTimings also collects the phases reported by --trace-timings.
+	traceTimings bool
+}
+
+// scenarios returns the benchmarks in the order they run. The first-run
+// install leaves the distro registered as root for the following ones. The
+// first shells after a fresh install, with and without --fast-first-boot,
+// come last as they reinstall the distro for every sample.
+func scenarios() []scenario {
+	return []scenario{
+		{name: "help", iterations: *iterations, args: []string{"help"}},
+		{name: "install-root", iterations: *installIterations, setup: unregisterDistro, args: []string{"install", "--root"}, traceTimings: true},
+		{name: "run-true-cold", iterations: *iterations, setup: shutdownWSL, args: []string{"run", "true"}},
+		{name: "run-true-warm", iterations: *iterations, setup: startDistro, args: []string{"run", "true"}},
+		{name: "config-default-user", iterations: *iterations, setup: startDistro, args: []string{"config", "--default-user", "root"}},
+		{name: "first-shell", iterations: *installIterations, setup: freshInstall(), args: []string{"run", "true"}},
+		{name: "first-shell-fast", iterations: *installIterations, setup: freshInstall("--fast-first-boot"), args: []string{"run", "true"}},
+	}
+}
+
+// measure times every sample of the scenario, and of its install phases if
+// requested.
+func (s scenario) measure(ctx context.Context) ([]summary, error) {
+	tracePath := filepath.Join(os.TempDir(), fmt.Sprintf("launcherbench-%d.json", os.Getpid()))
+	defer os.Remove(tracePath)
+
+	var samples []time.Duration
+	phases := make(map[string][]time.Duration)
+	var phaseOrder []string
+
+	for i := 0; i < s.iterations; i++ {
+		if s.setup != nil {
+			if err := s.setup(ctx); err != nil {
+				return nil, err
+			}
+		}
+
+		args := s.args
+		if s.traceTimings {
+			args = append([]string{"--trace-timings=" + tracePath}, args...)
+		}
+
+		// The launcher is started directly rather than through a shell so
+		// that only its own latency is measured.
+		// #nosec G204: the launcher name comes from the command line.
+		cmd := exec.CommandContext(ctx, *launcherName, args...)
+		start := time.Now()
+		out, err := cmd.CombinedOutput()
+		elapsed := time.Since(start)
+		if err != nil {
+			return nil, fmt.Errorf("%s %v: %v\n%s", *launcherName, args, err, out)
+		}
+		samples = append(samples, elapsed)
+
+		if !s.traceTimings {
+			continue
+		}
+
+		trace, err := readTrace(tracePath)
+		if err != nil {
+			return nil, err
+		}
+		for _, p := range trace {
+			if _, ok := phases[p.name]; !ok {
+				phaseOrder = append(phaseOrder, p.name)
+			}
+			phases[p.name] = append(phases[p.name], p.duration)
+		}
+	}
+
+	var results []summary
+	if sum, ok := summarize(s.name, samples); ok {
+		results = append(results, sum)
+	}
+	for _, name := range phaseOrder {
+		if sum, ok := summarize(s.name+"/"+name, phases[name]); ok {
+			results = append(results, sum)
+		}
+	}
+
+	return results, nil
+}
+
+type phase struct {
+	name     string
+	duration time.Duration
+}
+
+// readTrace parses the JSON report written by --trace-timings. Phases timed
+// more than once during a run, such as WslLaunchInteractive, are summed up.
+func readTrace(path string) ([]phase, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, fmt.Errorf("could not read timings report: %v", err)
+	}
+
+	var trace struct {
+		Phases []struct {
+			Name       string `json:"name"`
+			DurationUs int64  `json:"duration_us"`
+		} `json:"phases"`
+	}
+	if err := json.Unmarshal(data, &trace); err != nil {
+		return nil, fmt.Errorf("could not parse timings report: %v", err)
+	}
+
+	var phases []phase
+	index := make(map[string]int)
+	for _, p := range trace.Phases {
+		d := time.Duration(p.DurationUs) * time.Microsecond
+		if i, ok := index[p.Name]; ok {
+			phases[i].duration += d
+			continue
+		}
+		index[p.Name] = len(phases)
+		phases = append(phases, phase{name: p.Name, duration: d})
+	}
+
+	return phases, nil
+}
+
+// shutdownWSL stops the utility VM, so that the next launch is a cold start.
+func shutdownWSL(ctx context.Context) error {
+	if out, err := exec.CommandContext(ctx, "wsl.exe", "--shutdown").CombinedOutput(); err != nil {
+		return fmt.Errorf("could not shut WSL down: %v\n%s", err, out)
+	}
+	return nil
+}
+
+// startDistro ensures the distro is running, so that the next launch is a warm start.
+func startDistro(ctx context.Context) error {
+	if out, err := exec.CommandContext(ctx, "wsl.exe", "-d", *distroName, "--", "true").CombinedOutput(); err != nil {
+		return fmt.Errorf("could not start the distro: %v\n%s", err, out)
+	}
+	return nil
+}
+
+// freshInstall returns a setup step that installs the distro again as root with the extra
+// install options, then shuts WSL down so that the next launch is its first boot.
+func freshInstall(options ...string) func(ctx context.Context) error {
+	return func(ctx context.Context) error {
+		if err := unregisterDistro(ctx); err != nil {
+			return err
+		}
+
+		args := append([]string{"install", "--root"}, options...)
+		// #nosec G204: the launcher name comes from the command line.
+		if out, err := exec.CommandContext(ctx, *launcherName, args...).CombinedOutput(); err != nil {
+			return fmt.Errorf("could not install the distro: %v\n%s", err, out)
+		}
+		return shutdownWSL(ctx)
+	}
+}
+
+// unregisterDistro removes the distro if it is registered.
+func unregisterDistro(ctx context.Context) error {
+	state, err := distroState(ctx)
+	if err != nil || state == distroNotFound {
+		return err
+	}
+
+	if out, err := exec.CommandContext(ctx, "wsl.exe", "--unregister", *distroName).CombinedOutput(); err != nil {
+		return fmt.Errorf("could not unregister the distro: %v\n%s", err, out)
+	}
+	return nil
+}
+
+// distroState parses the output of "wsl -l -v" to find the state of the distro.
+func distroState(ctx context.Context) (string, error) {
+	// wsl -l -v outputs UTF-16 unless WSL_UTF8 is set (Available from 0.64.0 onwards).
+	cmd := exec.CommandContext(ctx, "wsl.exe", "-l", "-v")
+	cmd.Env = append(os.Environ(), "WSL_UTF8=1")
+	out, err := cmd.CombinedOutput()
+	if err != nil {
+		// This error shows up when there is no distro installed
+		if bytes.Contains(out, []byte("WSL_E_DEFAULT_DISTRO_NOT_FOUND")) {
+			return distroNotFound, nil
+		}
+		return "", fmt.Errorf("could not list distros: %v\n%s", err, out)
+	}
+
+	// Example line:
+	// * Ubuntu-22.04                      Stopped         2
+	pattern := regexp.MustCompile(`^(\*| ) ([a-zA-Z-_0-9.]+)\s+([a-zA-Z]+)\s+[0-9]$`)
+	scanner := bufio.NewScanner(bytes.NewReader(out))
+	for scanner.Scan() {
+		data := pattern.FindStringSubmatch(scanner.Text())
+		if len(data) == 4 && data[2] == *distroName {
+			return data[3], nil
+		}
+	}
+
+	return distroNotFound, scanner.Err()
+}
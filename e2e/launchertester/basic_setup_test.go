@@ -29,6 +29,9 @@ func TestBasicSetup(t *testing.T) {
 		// "UpgradePolicyIdempotent": testUpgradePolicyIdempotent,
 		"InteropIsEnabled": testInteropIsEnabled,
 		"HelpFlag":         testHelpFlag,
+		"BatchRun":         testBatchRun,
+		"PipedRun":         testPipedRun,
+		"ConfigShow":       testConfigShow,
 	}
 
 	for name, tc := range testCases {
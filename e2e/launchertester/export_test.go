@@ -0,0 +1,42 @@
+package launchertester
+
+import (
+	"context"
+	"os/exec"
+	"path/filepath"
+	"testing"
+
+	"github.com/stretchr/testify/require"
+)
+
+// TestExportRestore ensures export writes a backup that install --from restores, with the
+// files of the distribution.
+func TestExportRestore(t *testing.T) {
+	wslSetup(t)
+
+	ctx, cancel := context.WithTimeout(context.Background(), 2*installTimeout)
+	defer cancel()
+
+	out, err := launcherCommand(ctx, "install", "--root").CombinedOutput()
+	require.NoErrorf(t, err, "Setup: unexpected error installing: %s\n%v", out, err)
+
+	out, err = wslCommandAsUser(ctx, "root", "sh", "-c", "echo backed-up > /var/tmp/export-marker").CombinedOutput()
+	require.NoErrorf(t, err, "Setup: could not write the marker: %s", out)
+
+	backup := filepath.Join(t.TempDir(), "backup.tar.blk")
+	out, err = launcherCommand(ctx, "export", backup).CombinedOutput()
+	require.NoErrorf(t, err, "Unexpected error exporting: %s\n%v", out, err)
+	require.Contains(t, string(out), "Exported", "The export should have been reported")
+	require.FileExists(t, backup, "The backup should have been written")
+	require.NoFileExists(t, backup+".partial", "The partial backup should have been renamed")
+
+	out, err = exec.Command("wsl.exe", "--unregister", *distroName).CombinedOutput()
+	require.NoErrorf(t, err, "Setup: could not unregister the distro: %s", out)
+
+	out, err = launcherCommand(ctx, "install", "--from", backup).CombinedOutput()
+	require.NoErrorf(t, err, "Unexpected error restoring: %s\n%v", out, err)
+
+	out, err = wslCommandAsUser(ctx, "root", "cat", "/var/tmp/export-marker").CombinedOutput()
+	require.NoErrorf(t, err, "The restored distro should have the files of the backup: %s", out)
+	require.Equal(t, "backed-up\n", string(out), "The marker should have been restored")
+}
@@ -0,0 +1,54 @@
+package launchertester
+
+import (
+	"context"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/require"
+)
+
+// TestProvisionConfig ensures install --config creates the user, writes wsl.conf and runs the
+// first boot commands in a single pass, and makes the user the default one.
+func TestProvisionConfig(t *testing.T) {
+	wslSetup(t)
+
+	ctx, cancel := context.WithTimeout(context.Background(), 10*time.Minute)
+	defer cancel()
+
+	config := filepath.Join(t.TempDir(), "provision.ini")
+	err := os.WriteFile(config, []byte(`# Provisioning used by the end to end tests
+[user]
+name = provisioned
+groups = adm,sudo
+
+[wsl.conf.interop]
+appendWindowsPath = false
+
+[first-boot]
+touch /var/tmp/first-boot-done
+`), 0600)
+	require.NoError(t, err, "Setup: could not write the provisioning file")
+
+	out, err := launcherCommand(ctx, "install", "--config", config).CombinedOutput()
+	require.NoErrorf(t, err, "Unexpected error provisioning: %s\n%v", out, err)
+	require.Contains(t, string(out), "Provisioning the distribution in 3 steps", "All steps should have been planned")
+
+	out, err = wslCommand(ctx, "whoami").CombinedOutput()
+	require.NoErrorf(t, err, "Unexpected error running whoami: %s", out)
+	require.Equal(t, "provisioned", strings.TrimSpace(string(out)), "The provisioned user should be the default one")
+
+	out, err = wslCommand(ctx, "id", "-nG").CombinedOutput()
+	require.NoErrorf(t, err, "Unexpected error listing groups: %s", out)
+	require.Contains(t, strings.Fields(string(out)), "sudo", "The provisioned user should be in the groups of the file")
+
+	out, err = wslCommandAsUser(ctx, "root", "cat", "/etc/wsl.conf").CombinedOutput()
+	require.NoErrorf(t, err, "Unexpected error reading wsl.conf: %s", out)
+	require.Contains(t, string(out), "[interop]\nappendWindowsPath = false", "wsl.conf should have been written")
+
+	out, err = wslCommandAsUser(ctx, "root", "test", "-f", "/var/tmp/first-boot-done").CombinedOutput()
+	require.NoErrorf(t, err, "The first boot commands should have run: %s", out)
+}
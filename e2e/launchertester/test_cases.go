@@ -4,7 +4,9 @@ import (
 	"bufio"
 	"bytes"
 	"context"
+	"os"
 	"os/exec"
+	"path/filepath"
 	"strings"
 	"testing"
 	"time"
@@ -175,3 +177,55 @@ func testHelpFlag(t *testing.T) {
 	require.NoError(t, err, "could not run '%s help': %v, %s", *launcherName, err, out)
 	require.Contains(t, string(out), usageFirstLine, "help command should have been picked up by the launcher")
 }
+
+// testBatchRun ensures run --batch runs the commands in order and stops at the first failure.
+func testBatchRun(t *testing.T) { //nolint: thelper, this is a test
+	ctx, cancel := context.WithTimeout(context.Background(), systemdBootTimeout)
+	defer cancel()
+
+	commands := filepath.Join(t.TempDir(), "commands.txt")
+	err := os.WriteFile(commands, []byte("# Comments and empty lines are skipped\n\necho first\nfalse\necho never\n"), 0600)
+	require.NoError(t, err, "Setup: could not write the batch file")
+
+	out, err := launcherCommand(ctx, "run", "--batch", commands).CombinedOutput()
+	require.Error(t, err, "run --batch should fail when a command fails: %s", out)
+	require.Contains(t, string(out), "first", "Commands before the failure should have run")
+	require.Contains(t, string(out), "[2/3] exit code 1", "The failing command should be reported")
+	require.NotContains(t, string(out), "never", "Commands after the failure should not have run")
+
+	out, err = launcherCommand(ctx, "run", "--batch", commands, "--keep-going").CombinedOutput()
+	require.Error(t, err, "run --batch --keep-going should still fail when a command fails: %s", out)
+	require.Contains(t, string(out), "never", "Commands after the failure should have run with --keep-going")
+}
+
+// testPipedRun ensures run passes redirected handles through untouched and propagates the exit code.
+func testPipedRun(t *testing.T) { //nolint: thelper, this is a test
+	ctx, cancel := context.WithTimeout(context.Background(), systemdBootTimeout)
+	defer cancel()
+
+	// The launcher is started directly so that its handles are pipes rather than a console.
+	input := bytes.Repeat([]byte("0123456789abcdef\x00\xff\r\n"), 64*1024)
+	cmd := exec.CommandContext(ctx, *launcherName, "run", "cat")
+	cmd.Stdin = bytes.NewReader(input)
+	out, err := cmd.Output()
+	require.NoError(t, err, "could not run '%s run cat'", *launcherName)
+	require.True(t, bytes.Equal(input, out), "Data should go through run unchanged: sent %d bytes, received %d", len(input), len(out))
+
+	err = exec.CommandContext(ctx, *launcherName, "run", "exit", "3").Run()
+	var target *exec.ExitError
+	require.ErrorAs(t, err, &target, "run should fail when the command fails")
+	require.Equal(t, 3, target.ExitCode(), "run should propagate the exit code of the command")
+}
+
+// testConfigShow ensures config --show reports the settings and that an unchanged default user is accepted.
+func testConfigShow(t *testing.T) { //nolint: thelper, this is a test
+	ctx, cancel := context.WithTimeout(context.Background(), systemdBootTimeout)
+	defer cancel()
+
+	out, err := launcherCommand(ctx, "config", "--show").CombinedOutput()
+	require.NoError(t, err, "could not run '%s config --show': %v, %s", *launcherName, err, out)
+	require.Contains(t, string(out), "Default UID:  0", "The distro was installed with --root, so root should be the default user")
+
+	out, err = launcherCommand(ctx, "config", "--default-user", "root").CombinedOutput()
+	require.NoError(t, err, "could not set the default user to the current one: %v, %s", err, out)
+}
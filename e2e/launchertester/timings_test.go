@@ -0,0 +1,68 @@
+package launchertester
+
+import (
+	"bytes"
+	"context"
+	"encoding/json"
+	"os"
+	"path/filepath"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/require"
+)
+
+// TestTraceTimings ensures --trace-timings reports every install phase as JSON,
+// and that --progress-json reports the import as it goes.
+func TestTraceTimings(t *testing.T) {
+	wslSetup(t)
+
+	ctx, cancel := context.WithTimeout(context.Background(), 10*time.Minute)
+	defer cancel()
+
+	report := filepath.Join(t.TempDir(), "timings.json")
+	progressReport := filepath.Join(t.TempDir(), "progress.json")
+	out, err := launcherCommand(ctx, "--trace-timings="+report, "--progress-json="+progressReport, "install", "--root").CombinedOutput()
+	require.NoErrorf(t, err, "Unexpected error installing: %s\n%v", out, err)
+	require.Contains(t, string(out), "Duration (ms)", "Timings table should be printed on exit")
+
+	data, err := os.ReadFile(report)
+	require.NoError(t, err, "Timings report should have been written")
+
+	var timings struct {
+		Distribution string
+		Phases       []struct {
+			Name       string
+			Depth      int
+			DurationUs int64 `json:"duration_us"`
+			Result     string
+		}
+	}
+	require.NoError(t, json.Unmarshal(data, &timings), "Timings report should be valid JSON")
+	require.Equal(t, *distroName, timings.Distribution, "Timings report should name the distro")
+
+	phases := make(map[string]string)
+	for _, p := range timings.Phases {
+		phases[p.Name] = p.Result
+	}
+
+	for _, name := range []string{"install", "register", "WslRegisterDistribution", "resolv.conf"} {
+		require.Containsf(t, phases, name, "Phase %q should have been timed", name)
+		require.Equalf(t, "0x00000000", phases[name], "Phase %q should have succeeded", name)
+	}
+
+	data, err = os.ReadFile(progressReport)
+	require.NoError(t, err, "Progress report should have been written")
+
+	lines := bytes.Split(bytes.TrimSpace(data), []byte("\n"))
+	var progress struct {
+		Bytes      int64
+		TotalBytes int64 `json:"total_bytes"`
+		Done       bool
+		Result     string
+	}
+	require.NoError(t, json.Unmarshal(lines[len(lines)-1], &progress), "Progress report should be JSON lines")
+	require.True(t, progress.Done, "The last progress report should be the final one")
+	require.Equal(t, "0x00000000", progress.Result, "The import should have succeeded")
+	require.Positive(t, progress.Bytes, "Some bytes should have been imported")
+}
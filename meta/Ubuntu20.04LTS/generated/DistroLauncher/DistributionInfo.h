@@ -18,8 +18,12 @@ namespace DistributionInfo
     // The title bar for the console window while the distribution is installing.
     const std::wstring WindowTitle = L"Ubuntu 20.04.6 LTS";
 
-    // Create and configure a user account.
-    bool CreateUser(std::wstring_view userName);
+    // The groups user accounts are added to, separated by commas.
+    const std::wstring UserGroups = L"adm,dialout,cdrom,floppy,sudo,audio,dip,video,plugdev,netdev";
+
+    // Create and configure a user account and return its UID, or UID_INVALID
+    // if the account could not be created.
+    ULONG CreateUser(std::wstring_view userName);
 
     // Query the UID of the user account.
     ULONG QueryUid(std::wstring_view userName);
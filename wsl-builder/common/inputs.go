@@ -0,0 +1,91 @@
+package common
+
+import (
+	"bytes"
+	"crypto/sha256"
+	"encoding/json"
+	"fmt"
+	"io"
+	"os"
+)
+
+// InputsFile is the manifest of the inputs a release generated directory was created from.
+// It lives next to the generated directory: meta/<AppID>/inputs.json.
+const InputsFile = "inputs.json"
+
+// inputsVersion is bumped whenever the way releases are generated changes, so that all of
+// them are generated again.
+const inputsVersion = 1
+
+// ReleaseInputs lists everything a release generated directory depends on.
+type ReleaseInputs struct {
+	Version int
+	// Release is the information derived from the row of the release in the releases CSV.
+	Release WslReleaseInfo
+	// Files maps the path of each template, image and override used, relative to its source
+	// directory, to the SHA256 of its content.
+	Files map[string]string
+}
+
+// NewReleaseInputs computes the inputs of a release from its information and the files it is
+// generated from. files maps each relative path to the file on disk.
+func NewReleaseInputs(r WslReleaseInfo, files map[string]string) (inputs ReleaseInputs, err error) {
+	inputs = ReleaseInputs{
+		Version: inputsVersion,
+		Release: r,
+		Files:   make(map[string]string),
+	}
+
+	for relPath, path := range files {
+		sum, err := fileSHA256(path)
+		if err != nil {
+			return inputs, fmt.Errorf("can't compute inputs of %s: %v", r.AppID, err)
+		}
+		inputs.Files[relPath] = sum
+	}
+
+	return inputs, nil
+}
+
+// ReadReleaseInputs reads the inputs manifest at path.
+func ReadReleaseInputs(path string) (inputs ReleaseInputs, err error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return inputs, err
+	}
+	if err := json.Unmarshal(data, &inputs); err != nil {
+		return inputs, fmt.Errorf("invalid inputs manifest %q: %v", path, err)
+	}
+	return inputs, nil
+}
+
+// Equal returns whether both inputs would generate the same release.
+func (i ReleaseInputs) Equal(other ReleaseInputs) bool {
+	// Maps are marshalled with sorted keys, so the encoding is canonical.
+	a, errA := json.Marshal(i)
+	b, errB := json.Marshal(other)
+	return errA == nil && errB == nil && bytes.Equal(a, b)
+}
+
+// Write writes the inputs manifest to path.
+func (i ReleaseInputs) Write(path string) error {
+	data, err := json.MarshalIndent(i, "", "  ")
+	if err != nil {
+		return err
+	}
+	return os.WriteFile(path, append(data, '\n'), 0644)
+}
+
+func fileSHA256(path string) (string, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return "", err
+	}
+	defer f.Close()
+
+	h := sha256.New()
+	if _, err := io.Copy(h, f); err != nil {
+		return "", err
+	}
+	return fmt.Sprintf("%x", h.Sum(nil)), nil
+}
@@ -8,11 +8,13 @@ import (
 	_ "image/png"
 	"io/fs"
 	"io/ioutil"
+	"log"
 	"os"
 	"os/exec"
 	"path/filepath"
 	"sort"
 	"strings"
+	"sync"
 	"text/template"
 
 	shutil "github.com/termie/go-shutil"
@@ -26,7 +28,9 @@ const (
 )
 
 // updateAssets orchestrates the distro launcher metadata and assets generation from a csv file path.
-func updateAssets(csvPath string) error {
+// Releases are generated by jobs workers, and rendered images are cached in cacheDir.
+// Releases whose inputs did not change since they were last generated are skipped, unless force is set.
+func updateAssets(csvPath, cacheDir string, jobs int, force bool) error {
 	// pngquant is a required dependency
 	if _, err := exec.LookPath("pngquant"); err != nil {
 		return err
@@ -62,40 +66,106 @@ func updateAssets(csvPath string) error {
 		return err
 	}
 
-	// Update each application
+	cache, err := newImageCache(cacheDir)
+	if err != nil {
+		return err
+	}
+
+	// Update each application on its own worker. Every release is generated from scratch in a
+	// staging directory, and only the files that differ are then written to its generated one.
+	releases := make(chan common.WslReleaseInfo)
+	errs := make(chan error, len(releasesInfo))
+	var wg sync.WaitGroup
+	for i := 0; i < jobs; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for r := range releases {
+				errs <- updateRelease(r, files, rootPath, metaPath, cache, force)
+			}
+		}()
+	}
 	for _, r := range releasesInfo {
-		wslPath := filepath.Join(metaPath, r.AppID)
-		generatedPath := filepath.Join(wslPath, common.GeneratedDir)
+		releases <- r
+	}
+	close(releases)
+	wg.Wait()
+	close(errs)
 
-		// Cleanup previous generated directory
-		if err := os.RemoveAll(generatedPath); err != nil {
+	for err := range errs {
+		if err != nil {
 			return err
 		}
+	}
 
-		// Reference files for this application
-		refFiles := make(map[string]string)
-		for k, v := range files {
-			refFiles[k] = v
-		}
+	return nil
+}
 
-		// Collect all files we can use overridding the main ones
-		if refFiles, err = listFilesForMeta(refFiles, filepath.Join(wslPath, "src"), nil, true,
-			filepath.Join(wslPath, "src")); err != nil {
-			return err
-		}
+// updateRelease generates the metadata and assets of a given release and updates its generated directory.
+func updateRelease(r common.WslReleaseInfo, files map[string]string, rootPath, metaPath string, cache imageCache, force bool) (err error) {
+	wslPath := filepath.Join(metaPath, r.AppID)
+	generatedPath := filepath.Join(wslPath, common.GeneratedDir)
+	inputsPath := filepath.Join(wslPath, common.InputsFile)
 
-		// And now, generate the application meta from xml template
-		if err := generateMetaForRelease(r, refFiles, rootPath, generatedPath); err != nil {
-			return err
-		}
+	// Reference files for this application
+	refFiles := make(map[string]string)
+	for k, v := range files {
+		refFiles[k] = v
+	}
 
-		// Generate the application and launcher icons
-		if err := generateImages(r, refFiles, rootPath, generatedPath); err != nil {
-			return err
+	// Collect all files we can use overridding the main ones
+	if refFiles, err = listFilesForMeta(refFiles, filepath.Join(wslPath, "src"), nil, true,
+		filepath.Join(wslPath, "src")); err != nil {
+		return err
+	}
+
+	// Skip the release if nothing it is generated from changed. The reference images only
+	// give the size of the generated ones, but are part of the inputs all the same.
+	inputFiles := make(map[string]string)
+	for k, v := range refFiles {
+		inputFiles[k] = v
+	}
+	assetsRefPath := filepath.Join(rootPath, "DistroLauncher-Appx", "Assets")
+	images, err := os.ReadDir(assetsRefPath)
+	if err != nil {
+		return err
+	}
+	for _, f := range images {
+		inputFiles[filepath.Join("reference", "DistroLauncher-Appx", "Assets", f.Name())] = filepath.Join(assetsRefPath, f.Name())
+	}
+	inputs, err := common.NewReleaseInputs(r, inputFiles)
+	if err != nil {
+		return err
+	}
+	if previous, err := common.ReadReleaseInputs(inputsPath); !force && err == nil && previous.Equal(inputs) {
+		if _, err := os.Stat(generatedPath); err == nil {
+			log.Printf("%s: up to date", r.AppID)
+			return nil
 		}
 	}
 
-	return nil
+	stagingPath, err := os.MkdirTemp("", "prepare-assets-*")
+	if err != nil {
+		return err
+	}
+	defer os.RemoveAll(stagingPath)
+
+	// And now, generate the application meta from xml template
+	if err := generateMetaForRelease(r, refFiles, rootPath, stagingPath); err != nil {
+		return err
+	}
+
+	// Generate the application and launcher icons
+	if err := generateImages(r, refFiles, rootPath, stagingPath, cache); err != nil {
+		return err
+	}
+
+	updated, removed, err := syncTree(stagingPath, generatedPath)
+	if err != nil {
+		return fmt.Errorf("can't update generated files for %s: %v", r.AppID, err)
+	}
+	log.Printf("%s: %d files updated, %d removed", r.AppID, updated, removed)
+	return inputs.Write(inputsPath)
 }
 
 // listFilesForMeta collects all templates files, icons and store content in every given path.
@@ -281,7 +351,7 @@ func listAndSortImagesIn(path string) ([]string, error) {
 }
 
 // generateImages creates .png and icons using templated svg.
-func generateImages(r common.WslReleaseInfo, templates map[string]string, rootPath, generatedPath string) (err error) {
+func generateImages(r common.WslReleaseInfo, templates map[string]string, rootPath, generatedPath string, cache imageCache) (err error) {
 	// Iterates and generates over generated assets as a reference
 
 	// A. Store and application images
@@ -337,6 +407,16 @@ func generateImages(r common.WslReleaseInfo, templates map[string]string, rootPa
 			return err
 		}
 
+		assetsDest := filepath.Join(generatedPath, relDir, f.Name())
+		format := strings.TrimPrefix(filepath.Ext(f.Name()), ".")
+		key := cache.key(templateBuf.Bytes(), format, uint(ref.Width), uint(ref.Height))
+		if img, ok := cache.get(key); ok {
+			if err := os.WriteFile(assetsDest, img, 0644); err != nil {
+				return err
+			}
+			continue
+		}
+
 		// 4. Rescale
 		// Reuse existing templates
 		mw, exists := mwTemplates[templateName]
@@ -360,7 +440,7 @@ func generateImages(r common.WslReleaseInfo, templates map[string]string, rootPa
 		if err := mw.SetImageDepth(8); err != nil {
 			return err
 		}
-		if err := mw.SetImageFormat(strings.TrimPrefix(filepath.Ext(f.Name()), ".")); err != nil {
+		if err := mw.SetImageFormat(format); err != nil {
 			return err
 		}
 		if err := mw.ResizeImage(uint(ref.Width), uint(ref.Height), imagick.FILTER_LANCZOS, 1); err != nil {
@@ -384,19 +464,12 @@ func generateImages(r common.WslReleaseInfo, templates map[string]string, rootPa
 			img = out.Bytes()
 		}
 
-		assetsDest := filepath.Join(generatedPath, relDir, f.Name())
-		if err := os.MkdirAll(filepath.Dir(assetsDest), 0755); err != nil {
+		if err := os.WriteFile(assetsDest, img, 0644); err != nil {
 			return err
 		}
-		f, err := os.Create(assetsDest)
-		if err != nil {
+		if err := cache.put(key, img); err != nil {
 			return err
 		}
-		defer f.Close()
-		if _, err := f.Write(img); err != nil {
-			return err
-		}
-		f.Close()
 	}
 
 	// B. Icon files
@@ -410,31 +483,41 @@ func generateImages(r common.WslReleaseInfo, templates map[string]string, rootPa
 	}
 	defer os.RemoveAll(tmpDir)
 	src := filepath.Join(tmpDir, "icon.svg")
-	srcF, err := os.Create(src)
-	if err != nil {
-		return err
-	}
-	defer srcF.Close()
 
 	templateData, err := os.ReadFile(templates[iconRelPath])
 	if err != nil {
 		return err
 	}
 	t := template.Must(template.New("").Parse(string(templateData)))
-	if err := t.Execute(srcF, r); err != nil {
+	var iconBuf bytes.Buffer
+	if err := t.Execute(&iconBuf, r); err != nil {
 		return err
 	}
-	srcF.Close()
 
 	dest := filepath.Join(generatedPath, strings.ReplaceAll(iconRelPath, ".svg", ".ico"))
 	if err := os.MkdirAll(filepath.Dir(dest), 0755); err != nil {
 		return err
 	}
 
-	_, err = imagick.ConvertImageCommand([]string{
+	key := cache.key(iconBuf.Bytes(), "ico", 256, 256)
+	if icon, ok := cache.get(key); ok {
+		return os.WriteFile(dest, icon, 0644)
+	}
+
+	if err := os.WriteFile(src, iconBuf.Bytes(), 0644); err != nil {
+		return err
+	}
+	if _, err = imagick.ConvertImageCommand([]string{
 		"convert", "-strip", "-background", "none", src, "-resize", "256x256", "-define",
 		"icon:auto-resize=16,32,48,256",
 		dest,
-	})
-	return err
+	}); err != nil {
+		return err
+	}
+
+	icon, err := os.ReadFile(dest)
+	if err != nil {
+		return err
+	}
+	return cache.put(key, icon)
 }
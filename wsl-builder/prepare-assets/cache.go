@@ -0,0 +1,138 @@
+package main
+
+import (
+	"bytes"
+	"crypto/sha256"
+	"errors"
+	"fmt"
+	"io/fs"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"sort"
+
+	"gopkg.in/gographics/imagick.v2/imagick"
+)
+
+// imageCache stores rendered images by a hash of everything they are rendered from.
+type imageCache struct {
+	dir string
+	// toolsVersion identifies the versions of ImageMagick and pngquant, which both affect the output.
+	toolsVersion string
+}
+
+// newImageCache opens the image cache in dir, creating it if needed.
+func newImageCache(dir string) (c imageCache, err error) {
+	if err := os.MkdirAll(dir, 0755); err != nil {
+		return c, fmt.Errorf("can't create image cache: %v", err)
+	}
+
+	magickVersion, _ := imagick.GetVersion()
+	pngquantVersion, err := exec.Command("pngquant", "--version").Output()
+	if err != nil {
+		return c, fmt.Errorf("can't get pngquant version: %v", err)
+	}
+
+	return imageCache{
+		dir:          dir,
+		toolsVersion: fmt.Sprintf("%s\n%s", magickVersion, bytes.TrimSpace(pngquantVersion)),
+	}, nil
+}
+
+// key returns the cache key of an image rendered from svg in format, at the given size.
+func (c imageCache) key(svg []byte, format string, width, height uint) string {
+	h := sha256.New()
+	fmt.Fprintf(h, "%s\n%s\n%dx%d\n", c.toolsVersion, format, width, height)
+	h.Write(svg)
+	return fmt.Sprintf("%x", h.Sum(nil))
+}
+
+// get returns the cached image for key, if any. Empty entries, which a full disk
+// or a crash can leave behind, are never valid images and count as misses.
+func (c imageCache) get(key string) ([]byte, bool) {
+	data, err := os.ReadFile(filepath.Join(c.dir, key))
+	if err != nil || len(data) == 0 {
+		return nil, false
+	}
+	return data, true
+}
+
+// put stores the image for key. It is written to a temporary file first so that
+// concurrent workers never read a partial image.
+func (c imageCache) put(key string, data []byte) error {
+	f, err := os.CreateTemp(c.dir, key+".*")
+	if err != nil {
+		return err
+	}
+	defer os.Remove(f.Name())
+
+	if _, err := f.Write(data); err != nil {
+		f.Close()
+		return err
+	}
+	if err := f.Close(); err != nil {
+		return err
+	}
+	return os.Rename(f.Name(), filepath.Join(c.dir, key))
+}
+
+// syncTree makes dest identical to src. Files are only written when their content differs,
+// and files and directories of dest that are not in src are removed.
+func syncTree(src, dest string) (updated, removed int, err error) {
+	wanted := make(map[string]bool)
+	err = filepath.WalkDir(src, func(path string, d fs.DirEntry, err error) error {
+		if err != nil {
+			return err
+		}
+		relPath, err := filepath.Rel(src, path)
+		if err != nil {
+			return err
+		}
+		wanted[relPath] = true
+		destPath := filepath.Join(dest, relPath)
+		if d.IsDir() {
+			return os.MkdirAll(destPath, 0755)
+		}
+
+		data, err := os.ReadFile(path)
+		if err != nil {
+			return err
+		}
+		if current, err := os.ReadFile(destPath); err == nil && bytes.Equal(current, data) {
+			return nil
+		}
+		updated++
+		return os.WriteFile(destPath, data, 0644)
+	})
+	if err != nil {
+		return updated, removed, err
+	}
+
+	// Remove deeper paths first, so that directories are empty when they are removed.
+	var stale []string
+	err = filepath.WalkDir(dest, func(path string, d fs.DirEntry, err error) error {
+		if err != nil {
+			return err
+		}
+		relPath, err := filepath.Rel(dest, path)
+		if err != nil {
+			return err
+		}
+		if !wanted[relPath] {
+			stale = append(stale, path)
+		}
+		return nil
+	})
+	if err != nil && !errors.Is(err, fs.ErrNotExist) {
+		return updated, removed, err
+	}
+	sort.Sort(sort.Reverse(sort.StringSlice(stale)))
+	for _, path := range stale {
+		if err := os.RemoveAll(path); err != nil {
+			return updated, removed, err
+		}
+		removed++
+	}
+
+	return updated, removed, nil
+}
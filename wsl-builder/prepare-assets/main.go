@@ -2,12 +2,19 @@ package main
 
 import (
 	"errors"
+	"fmt"
 	"log"
+	"os"
+	"path/filepath"
+	"runtime"
 
 	"github.com/spf13/cobra"
 )
 
 func main() {
+	var jobs *int
+	var cacheDir *string
+	var force *bool
 	rootCmd := &cobra.Command{
 		Use:   "prepare-assets CSV_FILE",
 		Short: "Update all releases in WSL distribution info and assets from template",
@@ -17,11 +24,22 @@ func main() {
 			if len(args) != 1 {
 				return errors.New("this command accepts exactly one CSV file")
 			}
+			if *jobs < 1 {
+				return fmt.Errorf("--jobs must be at least 1, got %d", *jobs)
+			}
 
-			return updateAssets(args[0])
+			return updateAssets(args[0], *cacheDir, *jobs, *force)
 		},
 	}
 
+	defaultCacheDir := filepath.Join(os.TempDir(), "wsl-builder-assets")
+	if userCacheDir, err := os.UserCacheDir(); err == nil {
+		defaultCacheDir = filepath.Join(userCacheDir, "wsl-builder", "assets")
+	}
+	jobs = rootCmd.Flags().Int("jobs", runtime.NumCPU(), "Number of releases to generate at once")
+	cacheDir = rootCmd.Flags().String("cache-dir", defaultCacheDir, "Directory where rendered images are cached")
+	force = rootCmd.Flags().Bool("force", false, "Generate every release, even those whose inputs did not change")
+
 	err := rootCmd.Execute()
 	if err != nil {
 		log.Fatal(err)
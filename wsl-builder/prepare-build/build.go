@@ -34,7 +34,7 @@ var (
 )
 
 // prepareBuild finds the correct paths of the VS projects, prepare build assets and get rootfs images.
-func prepareBuild(buildIDPath, appID, rootfses string, noChecksum bool, buildID int) error {
+func prepareBuild(buildIDPath, appID, rootfses, cacheDir string, noChecksum, pack, vhdx bool, buildID int) error {
 	metaPath, err := common.GetPath("meta")
 	if err != nil {
 		return err
@@ -51,7 +51,7 @@ func prepareBuild(buildIDPath, appID, rootfses string, noChecksum bool, buildID
 		buildNumber = fmt.Sprintf("%d", buildID)
 	}
 
-	archs, err := getRootfses(rootPath, rootfses, noChecksum)
+	archs, err := getRootfses(rootPath, rootfses, cacheDir, noChecksum, pack, vhdx)
 	if err != nil {
 		return err
 	}
@@ -93,26 +93,52 @@ func extractAndStoreNextBuildNumber(buildIDPath string) (buildNumber string, err
 // getRootfs downloads one rootfs file in tar.gz format and place
 // it where the distro launcher build system expects. If `uri` points to
 // a local regular file, it is copied from disk instead of downloaded.
-func getRootfs(uri, rootPath, winArch string, noChecksum bool) error {
+// If `pack` is true, a packed rootfs is generated next to it.
+// If `vhdx` is true, a prebuilt ext4 disk is generated next to it.
+func getRootfs(uri, rootPath, winArch, cacheDir string, noChecksum, pack, vhdx bool) error {
+	if err := getRootfsTarball(uri, rootPath, winArch, cacheDir, noChecksum); err != nil {
+		return err
+	}
+
+	tarball := filepath.Join(rootPath, winArch, "install.tar.gz")
+	if pack {
+		if err := packRootfs(tarball, filepath.Join(rootPath, winArch, "install.tar.blk")); err != nil {
+			return err
+		}
+	}
+
+	if vhdx {
+		if err := buildVhdx(tarball, filepath.Join(rootPath, winArch, "install.vhdx")); err != nil {
+			return err
+		}
+	}
+
+	return nil
+}
+
+// getRootfsTarball obtains the install.tar.gz file for winArch and checksums it if `noChecksum==false`.
+// Checksummed rootfses are kept in cacheDir, if not empty, and only downloaded again once they change.
+func getRootfsTarball(uri, rootPath, winArch, cacheDir string, noChecksum bool) error {
 	if err := os.MkdirAll(winArch, 0755); err != nil {
 		return err
 	}
 
+	dest := filepath.Join(rootPath, winArch, "install.tar.gz")
 	if isLocalFile(uri) {
 		if !noChecksum {
 			log.Printf("Checksum not supported for local URI")
 		}
-		return copyLocalFile(uri, filepath.Join(rootPath, winArch, "install.tar.gz"))
-	}
-
-	if err := downloadFile(uri, filepath.Join(rootPath, winArch, "install.tar.gz")); err != nil {
+		_, err := copyLocalFile(uri, dest)
 		return err
 	}
 
 	if noChecksum {
-		return nil
+		_, err := downloadFile(uri, dest)
+		return err
 	}
 
+	// The checksum file is downloaded first, as it is the key of the rootfs in the cache.
+
 	u, err := url.Parse(uri)
 	if err != nil {
 		return err
@@ -120,18 +146,38 @@ func getRootfs(uri, rootPath, winArch string, noChecksum bool) error {
 	u.Path = filepath.Join(path.Dir(u.Path), "SHA256SUMS")
 	checksumURL := strings.ReplaceAll(u.String(), "%5C", "/")
 	checksumDest := filepath.Join(rootPath, winArch, "SHA256SUMS")
-	if err := downloadFile(checksumURL, checksumDest); err != nil {
+	if _, err := downloadFile(checksumURL, checksumDest); err != nil {
 		return err
 	}
-	if err := checksumMatches(filepath.Join(rootPath, winArch, "install.tar.gz"), filepath.Base(uri), checksumDest); err != nil {
+	wantChecksum, err := expectedChecksum(filepath.Base(uri), checksumDest)
+	if err != nil {
+		return fmt.Errorf("error checking checksum for: %q: %v", dest, err)
+	}
+
+	if cacheDir != "" && getCachedRootfs(cacheDir, wantChecksum, dest) {
+		return nil
+	}
+
+	// The checksum is computed while downloading, rather than reading the rootfs again afterwards.
+	gotChecksum, err := downloadFile(uri, dest)
+	if err != nil {
 		return err
 	}
+	if gotChecksum != wantChecksum {
+		return fmt.Errorf("error checking checksum for: %q: checksum don’t match: expected %q but got %q", dest, wantChecksum, gotChecksum)
+	}
+
+	if cacheDir != "" {
+		if err := cacheRootfs(cacheDir, wantChecksum, dest); err != nil {
+			log.Printf("Warning: could not cache %s: %v", uri, err)
+		}
+	}
 	return nil
 }
 
 // getRootfses returns a list of windows archs we will build on
 // and place rootfses into the path expected by the WSL build process for each arch.
-func getRootfses(rootPath, rootfses string, noChecksum bool) ([]string, error) {
+func getRootfses(rootPath, rootfses, cacheDir string, noChecksum, pack, vhdx bool) ([]string, error) {
 	requestedArches := make(map[string]struct{})
 
 	var g errgroup.Group
@@ -164,7 +210,7 @@ func getRootfses(rootPath, rootfses string, noChecksum bool) ([]string, error) {
 
 		// Obtains rootfs and checksum it if `noChecksum==false`
 		g.Go(func() error {
-			return getRootfs(rootfsURL, rootPath, winArch, noChecksum)
+			return getRootfs(rootfsURL, rootPath, winArch, cacheDir, noChecksum, pack, vhdx)
 		})
 	}
 
@@ -191,12 +237,12 @@ func isLocalFile(url string) bool {
 }
 
 // copyLocalFile copies a regular local file pointed by `url`
-// into a new file created at `dest`.
-func copyLocalFile(url, dest string) (err error) {
+// into a new file created at `dest`, and returns its checksum.
+func copyLocalFile(url, dest string) (checksum string, err error) {
 	log.Printf("copying file %s", url)
 	source, err := os.Open(url)
 	if err != nil {
-		return err
+		return "", err
 	}
 	defer source.Close()
 
@@ -211,8 +257,8 @@ func copyLocalFile(url, dest string) (err error) {
 	return writeContentInto(source, size, dest)
 }
 
-// downloadFile downloads a file from the address pointed by `url` into `dest`.
-func downloadFile(url, dest string) (err error) {
+// downloadFile downloads a file from the address pointed by `url` into `dest`, and returns its checksum.
+func downloadFile(url, dest string) (checksum string, err error) {
 	log.Printf("downloading file %s", url)
 	defer func() {
 		if err != nil {
@@ -233,12 +279,12 @@ func downloadFile(url, dest string) (err error) {
 	}
 	resp, err := netClient.Get(url)
 	if err != nil {
-		return err
+		return "", err
 	}
 	defer resp.Body.Close()
 
 	if resp.StatusCode >= 400 {
-		return fmt.Errorf("http request failed with code %d", resp.StatusCode)
+		return "", fmt.Errorf("http request failed with code %d", resp.StatusCode)
 	}
 
 	var size int
@@ -274,12 +320,12 @@ func (wc *writeCounter) Close() error {
 }
 
 // writeContentInto writes the content of the `source io.Reader`
-// into a new file created at `dest`.
+// into a new file created at `dest`, and returns its SHA256 checksum.
 // total is the total size of the content to be downloaded.
-func writeContentInto(source io.Reader, total uint64, dest string) (err error) {
+func writeContentInto(source io.Reader, total uint64, dest string) (checksum string, err error) {
 	out, err := os.Create(dest)
 	if err != nil {
-		return err
+		return "", err
 	}
 	wc := &writeCounter{
 		f:     out,
@@ -288,36 +334,19 @@ func writeContentInto(source io.Reader, total uint64, dest string) (err error) {
 	}
 	defer wc.Close()
 
-	_, err = io.Copy(wc, source)
-	return err
-}
-
-// checksumMatches checks the file pointed by `path` against values
-// provided in the `checksumPath` file.
-func checksumMatches(path, origName, checksumPath string) (err error) {
-	defer func() {
-		if err != nil {
-			err = fmt.Errorf("error checking checksum for: %q: %v", path, err)
-		}
-	}()
-
-	// Checksum of the rootfs
-	f, err := os.Open(path)
-	if err != nil {
-		return err
-	}
-	defer f.Close()
-
 	h := sha256.New()
-	if _, err := io.Copy(h, f); err != nil {
-		return err
+	if _, err := io.Copy(io.MultiWriter(wc, h), source); err != nil {
+		return "", err
 	}
-	gotChecksum := fmt.Sprintf("%x", h.Sum(nil))
+	return fmt.Sprintf("%x", h.Sum(nil)), nil
+}
 
+// expectedChecksum returns the checksum of `origName` provided in the `checksumPath` file.
+func expectedChecksum(origName, checksumPath string) (string, error) {
 	// Load checksum file
 	checksumF, err := os.Open(checksumPath)
 	if err != nil {
-		return err
+		return "", err
 	}
 	defer checksumF.Close()
 	scanner := bufio.NewScanner(checksumF)
@@ -328,7 +357,6 @@ func checksumMatches(path, origName, checksumPath string) (err error) {
 		text = append(text, scanner.Text())
 	}
 
-	var found bool
 	for _, l := range text {
 		e := strings.Fields(l)
 		if len(e) != 2 {
@@ -340,15 +368,9 @@ func checksumMatches(path, origName, checksumPath string) (err error) {
 			continue
 		}
 
-		found = true
-		if e[0] != gotChecksum {
-			return fmt.Errorf("checksum don’t match: expected %q but got %q", e[0], gotChecksum)
-		}
-	}
-	if !found {
-		return fmt.Errorf("couldn't find %q in checksum file", origName)
+		return e[0], nil
 	}
-	return nil
+	return "", fmt.Errorf("couldn't find %q in checksum file", origName)
 }
 
 // prepareAssets copies metadata and assets files, appending dynamic elements.
@@ -1,8 +1,12 @@
 package main
 
 import (
+	"bytes"
 	"encoding/json"
 	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
 	"strings"
 
 	"github.com/ubuntu/wsl/wsl-builder/common"
@@ -16,7 +20,9 @@ type matrixElem struct {
 }
 
 // buildGHMatrix computes the list of distro that needs to start a build request.
-func buildGHMatrix(csvPath, metaPath string) error {
+// If changedSince is not empty, only the releases whose inputs manifest changed since
+// that git revision are listed.
+func buildGHMatrix(csvPath, metaPath, changedSince string) error {
 	releasesInfo, err := common.ReleasesInfo(csvPath)
 	if err != nil {
 		return err
@@ -28,6 +34,15 @@ func buildGHMatrix(csvPath, metaPath string) error {
 		if !r.ShouldBuild {
 			continue
 		}
+		if changedSince != "" {
+			changed, err := inputsChanged(metaPath, r.AppID, changedSince)
+			if err != nil {
+				return err
+			}
+			if !changed {
+				continue
+			}
+		}
 
 		rootfsUrls := []string{}
 		for _, arch := range []string{"amd64", "arm64"} {
@@ -50,3 +65,27 @@ func buildGHMatrix(csvPath, metaPath string) error {
 	fmt.Println(string(d))
 	return nil
 }
+
+// inputsChanged returns whether the inputs manifest of appID differs from the one at the
+// git revision since. A release without a manifest, now or then, is always considered changed.
+func inputsChanged(metaPath, appID, since string) (bool, error) {
+	current, err := os.ReadFile(filepath.Join(metaPath, appID, common.InputsFile))
+	if err != nil {
+		return true, nil
+	}
+
+	rootPath := filepath.Dir(metaPath)
+	cmd := exec.Command("git", "-C", rootPath, "show", fmt.Sprintf("%s:meta/%s/%s", since, appID, common.InputsFile))
+	var stderr bytes.Buffer
+	cmd.Stderr = &stderr
+	previous, err := cmd.Output()
+	if err != nil {
+		// The manifest did not exist yet, or the revision is unknown: git reports both the same way.
+		if _, ok := err.(*exec.ExitError); ok {
+			return true, nil
+		}
+		return false, fmt.Errorf("can't read inputs of %s at %s: %v: %s", appID, since, err, stderr.String())
+	}
+
+	return !bytes.Equal(bytes.TrimSpace(current), bytes.TrimSpace(previous)), nil
+}
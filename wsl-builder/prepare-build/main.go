@@ -19,6 +19,7 @@ func main() {
 		},
 	}
 
+	var changedSince *string
 	buildGHMatrixCmd := &cobra.Command{
 		Use:   "build-github-matrix CSV_FILE",
 		Short: "Return a json list of all build combinations we support",
@@ -33,13 +34,17 @@ func main() {
 			if err != nil {
 				return err
 			}
-			return buildGHMatrix(args[0], metaPath)
+			return buildGHMatrix(args[0], metaPath, *changedSince)
 		},
 	}
 	rootCmd.AddCommand(buildGHMatrixCmd)
+	changedSince = buildGHMatrixCmd.Flags().String("changed-since", "", "Only list the releases whose meta/<AppID>/inputs.json changed since this git revision")
 
 	var noChecksum *bool
+	var packRootfs *bool
+	var buildVhdx *bool
 	var buildID *int
+	var cacheDir *string
 	prepareBuildCmd := &cobra.Command{
 		Use:   "prepare BUILDID_PATH APP_ID ROOTFSES",
 		Short: "Prepares the build source before calling msbuild",
@@ -48,12 +53,44 @@ func main() {
 			local file paths or urls each followed by ::<arch>`,
 		Args: cobra.ExactArgs(3),
 		RunE: func(cmd *cobra.Command, args []string) error {
-			return prepareBuild(args[0], args[1], args[2], *noChecksum, *buildID)
+			return prepareBuild(args[0], args[1], args[2], *cacheDir, *noChecksum, *packRootfs, *buildVhdx, *buildID)
 		},
 	}
 	rootCmd.AddCommand(prepareBuildCmd)
 	noChecksum = prepareBuildCmd.Flags().Bool("no-checksum", false, "Disable checksum verification on rootfses")
+	packRootfs = prepareBuildCmd.Flags().Bool("pack-rootfs", false, "Also generate a block-compressed rootfs the launcher can decode on every core (Windows only)")
+	buildVhdx = prepareBuildCmd.Flags().Bool("vhdx", false, "Also generate a prebuilt ext4 VHDX the launcher can import without extracting the rootfs (requires mkfs.ext4 from e2fsprogs 1.47.1 or later, and qemu-img)")
 	buildID = prepareBuildCmd.Flags().Int("build-id", -1, "Force a build ID")
+	cacheDir = prepareBuildCmd.Flags().String("cache-dir", defaultRootfsCacheDir(), "Keep the checksummed rootfses in this directory across builds, so that only the changed ones are downloaded again. Empty disables the cache")
+
+	var keep *[]string
+	makeDeltaCmd := &cobra.Command{
+		Use:   "make-delta OLD_ROOTFS NEW_ROOTFS DELTA",
+		Short: "Creates a delta updating an installed distro from one rootfs to the next",
+		Long: `This compares two tar.gz root file systems and writes to DELTA the entries
+			that were added or changed, along with the paths to remove and the checksums
+			verified by "launcher update --delta DELTA" before and after updating.`,
+		Args: cobra.ExactArgs(3),
+		RunE: func(cmd *cobra.Command, args []string) error {
+			return makeDelta(args[0], args[1], args[2], *keep)
+		},
+	}
+	rootCmd.AddCommand(makeDeltaCmd)
+	keep = makeDeltaCmd.Flags().StringSlice("keep", nil, "Additional paths, relative to the root of the rootfs, to leave out of the delta")
+
+	makeLayersCmd := &cobra.Command{
+		Use:   "make-layers ROOTFS [GROUP_ROOTFS...]",
+		Short: "Splits a rootfs into a base layer shared across a group of releases, and a release layer",
+		Long: `This writes next to the tar.gz ROOTFS a base layer with the entries identical in
+			ROOTFS and every GROUP_ROOTFS, a release layer with the rest of ROOTFS, and the
+			install.layers manifest the launcher imports them from. The base layer is
+			the same file for every member of the group.`,
+		Args: cobra.MinimumNArgs(1),
+		RunE: func(cmd *cobra.Command, args []string) error {
+			return makeLayers(args[0], args[1:])
+		},
+	}
+	rootCmd.AddCommand(makeLayersCmd)
 
 	err := rootCmd.Execute()
 	if err != nil {
@@ -0,0 +1,312 @@
+package main
+
+import (
+	"archive/tar"
+	"bufio"
+	"compress/gzip"
+	"crypto/sha256"
+	"fmt"
+	"io"
+	"log"
+	"os"
+	"path"
+	"sort"
+	"strings"
+)
+
+// A delta holds what changed between two rootfses, as applied by "launcher update --delta"
+// (see DistroLauncher/DeltaUpdate.cpp):
+//
+//	manifest/base.sha256:   checksums the installed files must match before the update
+//	manifest/replaced:      paths changing type, removed before the update, one per line
+//	manifest/removed:       paths to remove once the update is copied, one per line
+//	manifest/target.sha256: checksums the updated files must match afterwards
+//	rootfs/...:             new and changed entries, with the directories leading to them
+const (
+	deltaManifestDir = "manifest/"
+	deltaRootfsDir   = "rootfs/"
+)
+
+// deltaKeptPaths are never part of a delta: they are modified when the distro is set up,
+// so they would never match the base rootfs.
+var deltaKeptPaths = []string{
+	"./etc/passwd", "./etc/passwd-",
+	"./etc/group", "./etc/group-",
+	"./etc/shadow", "./etc/shadow-",
+	"./etc/gshadow", "./etc/gshadow-",
+	"./etc/subuid", "./etc/subuid-",
+	"./etc/subgid", "./etc/subgid-",
+	"./etc/hostname",
+	"./etc/hosts",
+	"./etc/resolv.conf",
+}
+
+// deltaKeptDirs are never part of a delta either, nor anything under them: they hold the
+// package manager state, which changes as soon as a package is installed in the distro,
+// and the logs.
+var deltaKeptDirs = []string{
+	"./var/lib/dpkg",
+	"./var/lib/apt",
+	"./var/cache/apt",
+	"./var/cache/debconf",
+	"./var/log",
+}
+
+type rootfsEntry struct {
+	header *tar.Header
+	sum    string
+}
+
+// rootfsIndex lists the entries of a rootfs, in archive order.
+type rootfsIndex struct {
+	entries map[string]rootfsEntry
+	order   []string
+}
+
+// makeDelta writes to dest the delta updating a distro installed from the tar.gz rootfs at
+// oldPath to the one at newPath. Paths in keep are left out of the delta, in addition to
+// the account databases and the files generated by WSL.
+func makeDelta(oldPath, newPath, dest string, keep []string) (err error) {
+	log.Printf("computing the delta from %s to %s", oldPath, newPath)
+	defer func() {
+		if err != nil {
+			err = fmt.Errorf("could not create delta %q: %v", dest, err)
+		}
+	}()
+
+	keptPaths := make(map[string]bool)
+	for _, p := range append(deltaKeptPaths, keep...) {
+		keptPaths[normalizeRootfsPath(p)] = true
+	}
+	kept := func(name string) bool {
+		if keptPaths[name] {
+			return true
+		}
+		for _, dir := range deltaKeptDirs {
+			if name == dir || strings.HasPrefix(name, dir+"/") {
+				return true
+			}
+		}
+		return false
+	}
+
+	oldIndex, err := indexRootfs(oldPath)
+	if err != nil {
+		return err
+	}
+	newIndex, err := indexRootfs(newPath)
+	if err != nil {
+		return err
+	}
+
+	// Entries that changed type are removed first, as they cannot be overwritten. The other
+	// ones are only removed once the new entries are in place.
+	var baseSums, targetSums, replaced, removed []string
+	included := make(map[string]bool)
+	for _, name := range oldIndex.order {
+		if kept(name) {
+			continue
+		}
+		o := oldIndex.entries[name]
+		n, found := newIndex.entries[name]
+		if found && !entryChanged(o, n) {
+			continue
+		}
+		if o.header.Typeflag == tar.TypeReg && isChecksumSafe(name) {
+			baseSums = append(baseSums, fmt.Sprintf("%s  %s", o.sum, name))
+		}
+		if strings.Contains(name, "\n") {
+			continue
+		}
+		if !found {
+			removed = append(removed, strings.TrimPrefix(name, "."))
+		} else if o.header.Typeflag != n.header.Typeflag {
+			replaced = append(replaced, strings.TrimPrefix(name, "."))
+		}
+	}
+
+	for _, name := range newIndex.order {
+		if kept(name) || name == "." {
+			continue
+		}
+		n := newIndex.entries[name]
+		if o, found := oldIndex.entries[name]; found && !entryChanged(o, n) {
+			continue
+		}
+		included[name] = true
+		if n.header.Typeflag == tar.TypeReg && isChecksumSafe(name) {
+			targetSums = append(targetSums, fmt.Sprintf("%s  %s", n.sum, name))
+		}
+		// Hard links are extracted next to their target, which must be in the delta too.
+		if n.header.Typeflag == tar.TypeLink {
+			included[normalizeRootfsPath(n.header.Linkname)] = true
+		}
+	}
+
+	// The directories leading to each entry are copied over with their own metadata, so
+	// they must not be created with default permissions.
+	for name := range included {
+		for dir := normalizeRootfsPath(path.Dir(name)); dir != "."; dir = normalizeRootfsPath(path.Dir(dir)) {
+			if _, found := newIndex.entries[dir]; found {
+				included[dir] = true
+			}
+		}
+	}
+	included["."] = true
+
+	log.Printf("%d entries changed or added, %d removed", len(included)-1, len(replaced)+len(removed))
+	sort.Strings(replaced)
+	sort.Strings(removed)
+	return writeDelta(newPath, dest, included, baseSums, targetSums, replaced, removed)
+}
+
+// indexRootfs reads the tar.gz rootfs at src and computes the checksum of its regular files.
+func indexRootfs(src string) (index rootfsIndex, err error) {
+	index.entries = make(map[string]rootfsEntry)
+	err = walkRootfs(src, func(hdr *tar.Header, r io.Reader) error {
+		name := normalizeRootfsPath(hdr.Name)
+		e := rootfsEntry{header: hdr}
+		if hdr.Typeflag == tar.TypeReg {
+			h := sha256.New()
+			if _, err := io.Copy(h, r); err != nil {
+				return err
+			}
+			e.sum = fmt.Sprintf("%x", h.Sum(nil))
+		}
+		if _, found := index.entries[name]; !found {
+			index.order = append(index.order, name)
+		}
+		index.entries[name] = e
+		return nil
+	})
+	return index, err
+}
+
+// writeDelta writes the manifest and the included entries of the tar.gz rootfs at newPath to dest.
+func writeDelta(newPath, dest string, included map[string]bool, baseSums, targetSums, replaced, removed []string) error {
+	f, err := os.Create(dest)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+	bw := bufio.NewWriter(f)
+	gz := gzip.NewWriter(bw)
+	tw := tar.NewWriter(gz)
+
+	if err := tw.WriteHeader(&tar.Header{Name: deltaManifestDir, Typeflag: tar.TypeDir, Mode: 0700}); err != nil {
+		return err
+	}
+	manifest := map[string][]string{
+		"base.sha256":   baseSums,
+		"replaced":      replaced,
+		"removed":       removed,
+		"target.sha256": targetSums,
+	}
+	for _, name := range []string{"base.sha256", "replaced", "removed", "target.sha256"} {
+		var content string
+		if len(manifest[name]) > 0 {
+			content = strings.Join(manifest[name], "\n") + "\n"
+		}
+		hdr := &tar.Header{Name: deltaManifestDir + name, Typeflag: tar.TypeReg, Mode: 0600, Size: int64(len(content))}
+		if err := tw.WriteHeader(hdr); err != nil {
+			return err
+		}
+		if _, err := io.WriteString(tw, content); err != nil {
+			return err
+		}
+	}
+
+	// The new rootfs is read again, so that entries keep their order and their content
+	// never has to be held in memory.
+	err = walkRootfs(newPath, func(hdr *tar.Header, r io.Reader) error {
+		name := normalizeRootfsPath(hdr.Name)
+		if !included[name] {
+			return nil
+		}
+		// Only keep the first entry for the root directory.
+		delete(included, ".")
+
+		h := *hdr
+		h.Name = deltaRootfsDir + strings.TrimPrefix(strings.TrimPrefix(name, "."), "/")
+		if h.Typeflag == tar.TypeDir && !strings.HasSuffix(h.Name, "/") {
+			h.Name += "/"
+		}
+		if h.Typeflag == tar.TypeLink {
+			h.Linkname = deltaRootfsDir + strings.TrimPrefix(normalizeRootfsPath(hdr.Linkname), "./")
+		}
+		if err := tw.WriteHeader(&h); err != nil {
+			return err
+		}
+		_, err := io.Copy(tw, r)
+		return err
+	})
+	if err != nil {
+		return err
+	}
+
+	if err := tw.Close(); err != nil {
+		return err
+	}
+	if err := gz.Close(); err != nil {
+		return err
+	}
+	if err := bw.Flush(); err != nil {
+		return err
+	}
+	return f.Close()
+}
+
+// walkRootfs calls fn on every entry of the tar.gz rootfs at src.
+func walkRootfs(src string, fn func(hdr *tar.Header, r io.Reader) error) error {
+	f, err := os.Open(src)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+	gz, err := gzip.NewReader(bufio.NewReader(f))
+	if err != nil {
+		return err
+	}
+	defer gz.Close()
+
+	tr := tar.NewReader(gz)
+	for {
+		hdr, err := tr.Next()
+		if err == io.EOF {
+			return nil
+		}
+		if err != nil {
+			return err
+		}
+		if err := fn(hdr, tr); err != nil {
+			return err
+		}
+	}
+}
+
+// entryChanged returns whether n differs from o in content or metadata.
+func entryChanged(o, n rootfsEntry) bool {
+	oh, nh := o.header, n.header
+	return oh.Typeflag != nh.Typeflag ||
+		o.sum != n.sum ||
+		oh.Linkname != nh.Linkname ||
+		oh.Mode != nh.Mode ||
+		oh.Uid != nh.Uid ||
+		oh.Gid != nh.Gid ||
+		oh.Devmajor != nh.Devmajor ||
+		oh.Devminor != nh.Devminor
+}
+
+// normalizeRootfsPath returns name relative to the root of the rootfs, as "./some/path".
+func normalizeRootfsPath(name string) string {
+	p := path.Clean("/" + name)
+	if p == "/" {
+		return "."
+	}
+	return "." + p
+}
+
+// isChecksumSafe returns whether name can be listed as is in a sha256sum file.
+func isChecksumSafe(name string) bool {
+	return !strings.ContainsAny(name, "\\\n")
+}
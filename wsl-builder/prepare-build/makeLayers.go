@@ -0,0 +1,242 @@
+package main
+
+import (
+	"archive/tar"
+	"bufio"
+	"compress/gzip"
+	"crypto/sha256"
+	"fmt"
+	"io"
+	"log"
+	"os"
+	"path/filepath"
+	"reflect"
+	"sort"
+	"strings"
+	"time"
+)
+
+// The rootfs of a package can be split into layers, as read by the launcher (see
+// DistroLauncher/RootfsImport.cpp). install.layers lists the layer files next to it, base
+// first, one per line. Each layer is a gzip member holding a tarball without its end of
+// archive, except for the last one, so that their concatenation is the tar.gz rootfs.
+//
+// The base layer holds the entries identical in all the rootfses of a group, such as the
+// point releases of a series on every architecture. It is written from canonical inputs,
+// so it is the same file in every package of the group, which Windows stores and downloads
+// once. The release layer holds the rest of the rootfs.
+const (
+	layersManifest = "install.layers"
+	layerPrefix    = "layer-"
+	layerSuffix    = ".tar.gz"
+)
+
+// makeLayers splits the tar.gz rootfs at rootfsPath into a base layer, shared with the
+// rootfses at groupPaths, and a release layer, next to it.
+func makeLayers(rootfsPath string, groupPaths []string) (err error) {
+	log.Printf("splitting %s into layers shared with %d other rootfses", rootfsPath, len(groupPaths))
+	defer func() {
+		if err != nil {
+			err = fmt.Errorf("could not create the layers of %q: %v", rootfsPath, err)
+		}
+	}()
+
+	// The base is always written from the same input, whichever member of the group is split.
+	canonical, err := canonicalRootfs(append([]string{rootfsPath}, groupPaths...))
+	if err != nil {
+		return err
+	}
+
+	canonicalIndex, err := indexRootfs(canonical)
+	if err != nil {
+		return err
+	}
+	shared := make(map[string]bool)
+	for name, e := range canonicalIndex.entries {
+		shared[name] = true
+		canonicalIndex.entries[name] = rootfsEntry{header: layerHeader(e.header), sum: e.sum}
+	}
+
+	for _, p := range append([]string{rootfsPath}, groupPaths...) {
+		if p == canonical {
+			continue
+		}
+		index, err := indexRootfs(p)
+		if err != nil {
+			return err
+		}
+		for name := range shared {
+			e, found := index.entries[name]
+			if !found || !layerEntryEqual(canonicalIndex.entries[name], rootfsEntry{header: layerHeader(e.header), sum: e.sum}) {
+				delete(shared, name)
+			}
+		}
+	}
+
+	// Hard links are extracted next to their target, which is only sure to be there if it
+	// is shared too.
+	for name := range shared {
+		h := canonicalIndex.entries[name].header
+		if h.Typeflag == tar.TypeLink && !shared[normalizeRootfsPath(h.Linkname)] {
+			delete(shared, name)
+		}
+	}
+
+	dir := filepath.Dir(rootfsPath)
+	var layers []string
+	if len(shared) > 0 {
+		base, err := writeLayer(canonical, dir, false, func(name string) bool { return shared[name] })
+		if err != nil {
+			return err
+		}
+		layers = append(layers, base)
+	}
+	release, err := writeLayer(rootfsPath, dir, true, func(name string) bool { return !shared[name] })
+	if err != nil {
+		return err
+	}
+	layers = append(layers, release)
+
+	log.Printf("%d entries shared in %s, the rest in %s", len(shared), layers[0], release)
+	if err := os.WriteFile(filepath.Join(dir, layersManifest), []byte(strings.Join(layers, "\n")+"\n"), 0644); err != nil {
+		return err
+	}
+	return removeStaleLayers(dir, layers)
+}
+
+// removeStaleLayers removes the layer files in dir left by earlier splits, which are not
+// in layers, as the package ships every layer file next to the manifest.
+func removeStaleLayers(dir string, layers []string) error {
+	stale, err := filepath.Glob(filepath.Join(dir, layerPrefix+"*"+layerSuffix))
+	if err != nil {
+		return err
+	}
+	listed := make(map[string]bool)
+	for _, name := range layers {
+		listed[name] = true
+	}
+	for _, p := range stale {
+		name := filepath.Base(p)
+		if listed[name] {
+			continue
+		}
+		log.Printf("removing stale layer %s", name)
+		if err := os.Remove(p); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// canonicalRootfs returns the rootfs of the group whose content has the lowest checksum.
+func canonicalRootfs(paths []string) (string, error) {
+	type rootfsSum struct {
+		path, sum string
+	}
+	var sums []rootfsSum
+	for _, p := range paths {
+		sum, err := fileChecksum(p)
+		if err != nil {
+			return "", err
+		}
+		sums = append(sums, rootfsSum{p, sum})
+	}
+	sort.Slice(sums, func(i, j int) bool { return sums[i].sum < sums[j].sum })
+	return sums[0].path, nil
+}
+
+// writeLayer writes, to a layer file in dir named by its checksum, the entries of the tar.gz
+// rootfs at src selected by include. Only the last layer ends the archive. It returns the
+// name of the layer file.
+func writeLayer(src, dir string, last bool, include func(name string) bool) (name string, err error) {
+	f, err := os.CreateTemp(dir, layerPrefix+"*.tmp")
+	if err != nil {
+		return "", err
+	}
+	defer os.Remove(f.Name())
+	defer f.Close()
+
+	h := sha256.New()
+	bw := bufio.NewWriter(io.MultiWriter(f, h))
+	gz := gzip.NewWriter(bw)
+	tw := tar.NewWriter(gz)
+
+	err = walkRootfs(src, func(hdr *tar.Header, r io.Reader) error {
+		if !include(normalizeRootfsPath(hdr.Name)) {
+			return nil
+		}
+		if err := tw.WriteHeader(layerHeader(hdr)); err != nil {
+			return err
+		}
+		_, err := io.Copy(tw, r)
+		return err
+	})
+	if err != nil {
+		return "", err
+	}
+
+	if last {
+		err = tw.Close()
+	} else {
+		err = tw.Flush()
+	}
+	if err != nil {
+		return "", err
+	}
+	if err := gz.Close(); err != nil {
+		return "", err
+	}
+	if err := bw.Flush(); err != nil {
+		return "", err
+	}
+	if err := f.Close(); err != nil {
+		return "", err
+	}
+
+	name = fmt.Sprintf("%s%x%s", layerPrefix, h.Sum(nil), layerSuffix)
+	return name, os.Rename(f.Name(), filepath.Join(dir, name))
+}
+
+// layerHeader returns hdr without the times that change every time a rootfs is built, so
+// that identical entries are written identically.
+func layerHeader(hdr *tar.Header) *tar.Header {
+	h := *hdr
+	h.AccessTime = time.Time{}
+	h.ChangeTime = time.Time{}
+	if len(hdr.PAXRecords) > 0 {
+		h.PAXRecords = make(map[string]string)
+		for k, v := range hdr.PAXRecords {
+			if k != "atime" && k != "ctime" {
+				h.PAXRecords[k] = v
+			}
+		}
+	}
+	return &h
+}
+
+// layerEntryEqual returns whether both entries would be extracted identically.
+func layerEntryEqual(o, n rootfsEntry) bool {
+	oh, nh := o.header, n.header
+	return !entryChanged(o, n) &&
+		oh.Name == nh.Name &&
+		oh.Size == nh.Size &&
+		oh.ModTime.Equal(nh.ModTime) &&
+		oh.Uname == nh.Uname &&
+		oh.Gname == nh.Gname &&
+		reflect.DeepEqual(oh.PAXRecords, nh.PAXRecords)
+}
+
+// fileChecksum returns the SHA256 of the file at path.
+func fileChecksum(path string) (string, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return "", err
+	}
+	defer f.Close()
+
+	h := sha256.New()
+	if _, err := io.Copy(h, bufio.NewReader(f)); err != nil {
+		return "", err
+	}
+	return fmt.Sprintf("%x", h.Sum(nil)), nil
+}
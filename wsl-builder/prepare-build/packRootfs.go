@@ -0,0 +1,168 @@
+package main
+
+import (
+	"bufio"
+	"compress/gzip"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"log"
+	"os"
+	"runtime"
+)
+
+const (
+	// packedMagic identifies a packed rootfs, as read by the launcher (see DistroLauncher/PackedRootfs.h).
+	packedMagic = "WSLBLK01"
+	// packedBlockSize is the size of uncompressed tarball each frame holds.
+	packedBlockSize = 4 << 20
+)
+
+// blockCompressor compresses independent blocks of data.
+type blockCompressor interface {
+	algorithm() uint32
+	compress(data []byte) ([]byte, error)
+	close() error
+}
+
+type packedBlock struct {
+	data       []byte
+	compressed []byte
+	err        error
+	done       chan struct{}
+}
+
+// packRootfs converts the tar.gz rootfs at src into a packed rootfs at dest.
+// Blocks are compressed on every core and frames are written in order.
+func packRootfs(src, dest string) (err error) {
+	log.Printf("packing %s", src)
+	defer func() {
+		if err != nil {
+			err = fmt.Errorf("could not pack %q: %v", src, err)
+		}
+	}()
+
+	f, err := os.Open(src)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+	tarball, err := gzip.NewReader(bufio.NewReader(f))
+	if err != nil {
+		return err
+	}
+	defer tarball.Close()
+
+	out, err := os.Create(dest)
+	if err != nil {
+		return err
+	}
+	defer out.Close()
+	w := bufio.NewWriter(out)
+
+	workers := runtime.NumCPU()
+	jobs := make(chan *packedBlock, workers)
+	ordered := make(chan *packedBlock, workers*2)
+
+	// All workers share the same algorithm: fetch it from the first compressor.
+	var algorithm uint32
+	compressors := make([]blockCompressor, workers)
+	for i := range compressors {
+		c, err := newBlockCompressor()
+		if err != nil {
+			for _, c := range compressors[:i] {
+				c.close()
+			}
+			return err
+		}
+		compressors[i] = c
+		algorithm = c.algorithm()
+	}
+
+	for _, c := range compressors {
+		go func(c blockCompressor) {
+			defer c.close()
+			for b := range jobs {
+				b.compressed, b.err = c.compress(b.data)
+				close(b.done)
+			}
+		}(c)
+	}
+
+	// Read the tarball block by block, preserving order through the ordered channel.
+	readErr := make(chan error, 1)
+	go func() {
+		defer close(ordered)
+		defer close(jobs)
+		for {
+			data := make([]byte, packedBlockSize)
+			n, err := io.ReadFull(tarball, data)
+			if n > 0 {
+				b := &packedBlock{data: data[:n], done: make(chan struct{})}
+				jobs <- b
+				ordered <- b
+			}
+			if err == io.EOF || err == io.ErrUnexpectedEOF {
+				readErr <- nil
+				return
+			}
+			if err != nil {
+				readErr <- err
+				return
+			}
+		}
+	}()
+
+	header := make([]byte, 0, len(packedMagic)+8)
+	header = append(header, packedMagic...)
+	header = binary.LittleEndian.AppendUint32(header, algorithm)
+	header = binary.LittleEndian.AppendUint32(header, packedBlockSize)
+	if _, err := w.Write(header); err != nil {
+		return err
+	}
+
+	var writeErr error
+	for b := range ordered {
+		<-b.done
+		if writeErr != nil {
+			continue
+		}
+		if b.err != nil {
+			writeErr = b.err
+			continue
+		}
+		writeErr = writeFrame(w, b)
+	}
+	if err := <-readErr; err != nil {
+		return err
+	}
+	if writeErr != nil {
+		return writeErr
+	}
+
+	// End frame
+	if _, err := w.Write(make([]byte, 8)); err != nil {
+		return err
+	}
+	if err := w.Flush(); err != nil {
+		return err
+	}
+	return out.Close()
+}
+
+// writeFrame writes one block. Blocks which don’t shrink are stored as-is.
+func writeFrame(w io.Writer, b *packedBlock) error {
+	payload := b.compressed
+	if len(payload) >= len(b.data) {
+		payload = b.data
+	}
+
+	frame := make([]byte, 0, 8)
+	frame = binary.LittleEndian.AppendUint32(frame, uint32(len(b.data)))
+	frame = binary.LittleEndian.AppendUint32(frame, uint32(len(payload)))
+	if _, err := w.Write(frame); err != nil {
+		return err
+	}
+	_, err := w.Write(payload)
+	return err
+}
@@ -0,0 +1,9 @@
+//go:build !windows
+
+package main
+
+import "errors"
+
+func newBlockCompressor() (blockCompressor, error) {
+	return nil, errors.New("packing a rootfs requires the Windows Compression API")
+}
@@ -0,0 +1,70 @@
+package main
+
+import (
+	"errors"
+	"syscall"
+	"unsafe"
+)
+
+const (
+	compressAlgorithmXpressHuff = 4
+	compressRaw                 = 1 << 29
+	errorInsufficientBuffer     = syscall.Errno(122)
+)
+
+var (
+	cabinet            = syscall.NewLazyDLL("cabinet.dll")
+	procCreateCompress = cabinet.NewProc("CreateCompressor")
+	procCompress       = cabinet.NewProc("Compress")
+	procCloseCompress  = cabinet.NewProc("CloseCompressor")
+)
+
+// windowsCompressor uses the Windows Compression API, which is what the launcher decodes with.
+type windowsCompressor struct {
+	handle uintptr
+}
+
+func newBlockCompressor() (blockCompressor, error) {
+	var handle uintptr
+	r, _, err := procCreateCompress.Call(compressAlgorithmXpressHuff|compressRaw, 0, uintptr(unsafe.Pointer(&handle)))
+	if r == 0 {
+		return nil, err
+	}
+	return &windowsCompressor{handle: handle}, nil
+}
+
+func (c *windowsCompressor) algorithm() uint32 {
+	return compressAlgorithmXpressHuff
+}
+
+func (c *windowsCompressor) compress(data []byte) ([]byte, error) {
+	if len(data) == 0 {
+		return nil, errors.New("can't compress an empty block")
+	}
+
+	out := make([]byte, len(data)+len(data)/8+4096)
+	for {
+		var size uintptr
+		r, _, err := procCompress.Call(c.handle,
+			uintptr(unsafe.Pointer(&data[0])), uintptr(len(data)),
+			uintptr(unsafe.Pointer(&out[0])), uintptr(len(out)),
+			uintptr(unsafe.Pointer(&size)))
+		if r != 0 {
+			return out[:size], nil
+		}
+		if !errors.Is(err, errorInsufficientBuffer) {
+			return nil, err
+		}
+		if int(size) <= len(out) {
+			size = uintptr(2 * len(out))
+		}
+		out = make([]byte, size)
+	}
+}
+
+func (c *windowsCompressor) close() error {
+	if r, _, err := procCloseCompress.Call(c.handle); r == 0 {
+		return err
+	}
+	return nil
+}
@@ -0,0 +1,107 @@
+package main
+
+import (
+	"io"
+	"log"
+	"os"
+	"path/filepath"
+	"strings"
+	"time"
+)
+
+// Verified rootfses are kept across builds in a cache directory, named by their checksum,
+// so that a build only downloads the rootfses that changed since the previous one.
+const (
+	rootfsCacheSuffix = ".tar.gz"
+
+	// rootfsCacheExpiry is how long a cached rootfs is kept after it was last used.
+	rootfsCacheExpiry = 30 * 24 * time.Hour
+)
+
+// defaultRootfsCacheDir returns the rootfs cache in the cache directory of the user, or an empty
+// path, which disables the cache, if there is none.
+func defaultRootfsCacheDir() string {
+	d, err := os.UserCacheDir()
+	if err != nil {
+		return ""
+	}
+	return filepath.Join(d, "wsl-builder", "rootfs")
+}
+
+// getCachedRootfs copies the rootfs with the given checksum from cacheDir into dest, and returns
+// whether it was there and intact. A corrupted entry is removed.
+func getCachedRootfs(cacheDir, checksum, dest string) bool {
+	cached := filepath.Join(cacheDir, checksum+rootfsCacheSuffix)
+	if _, err := os.Stat(cached); err != nil {
+		return false
+	}
+
+	// Mark the entry as used first, so that a concurrent build does not expire it.
+	now := time.Now()
+	if err := os.Chtimes(cached, now, now); err != nil {
+		log.Printf("Warning: could not refresh %s: %v", cached, err)
+	}
+
+	gotChecksum, err := copyLocalFile(cached, dest)
+	if err == nil && gotChecksum == checksum {
+		return true
+	}
+
+	log.Printf("Warning: discarding corrupted cached rootfs %s", cached)
+	if err := os.Remove(cached); err != nil {
+		log.Printf("Warning: could not remove %s: %v", cached, err)
+	}
+	return false
+}
+
+// cacheRootfs stores the verified rootfs at path in cacheDir under its checksum, and expires the
+// rootfses that were not used for longer than rootfsCacheExpiry.
+func cacheRootfs(cacheDir, checksum, path string) error {
+	if err := os.MkdirAll(cacheDir, 0755); err != nil {
+		return err
+	}
+
+	src, err := os.Open(path)
+	if err != nil {
+		return err
+	}
+	defer src.Close()
+
+	// Entries are written under a temporary name, so that an interrupted build never leaves a
+	// truncated rootfs behind its checksum.
+	tmp, err := os.CreateTemp(cacheDir, checksum+"-*.tmp")
+	if err != nil {
+		return err
+	}
+	defer os.Remove(tmp.Name())
+	defer tmp.Close()
+
+	if _, err := io.Copy(tmp, src); err != nil {
+		return err
+	}
+	if err := tmp.Close(); err != nil {
+		return err
+	}
+	if err := os.Rename(tmp.Name(), filepath.Join(cacheDir, checksum+rootfsCacheSuffix)); err != nil {
+		return err
+	}
+
+	entries, err := os.ReadDir(cacheDir)
+	if err != nil {
+		return err
+	}
+	for _, e := range entries {
+		if !strings.HasSuffix(e.Name(), rootfsCacheSuffix) {
+			continue
+		}
+		info, err := e.Info()
+		if err != nil || time.Since(info.ModTime()) < rootfsCacheExpiry {
+			continue
+		}
+		log.Printf("expiring cached rootfs %s", e.Name())
+		if err := os.Remove(filepath.Join(cacheDir, e.Name())); err != nil {
+			log.Printf("Warning: could not remove %s: %v", e.Name(), err)
+		}
+	}
+	return nil
+}